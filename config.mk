@@ -20,16 +20,27 @@ CONFIG_OPTS=-DUSE_SEMAPHORE=true -DSEMAPHORE_NAME=\"avolt\"
 # Install Paths
 PREFIX = /usr
 MANPREFIX = ${PREFIX}/share/man
+LIBPREFIX = ${PREFIX}/lib
+INCPREFIX = ${PREFIX}/include
 
 
 # Build files/Paths
 
 # Program binary name
 BIN        ?= $(PROGRAM_NAME)
+# Shared library name, contains everything except the program main
+LIB        := lib$(PROGRAM_NAME).so
+LIB_SOVERSION := 0
 # default build dir
 BUILDDIR   := build
 # Source dir
 SRCDIR     := src
+# Development tools source dir
+TOOLSDIR   := tools
+# Build dir of the library objects, compiled position independent
+LIB_BUILDDIR := $(BUILDDIR)/lib
+# Build dir of the tools, everything there is compiled with D_AVOLT_TRACE
+TOOLS_BUILDDIR := $(BUILDDIR)/tools
 # dir to store automatically generated dependency info files
 DEPDIR     := .deps
 
@@ -50,6 +61,8 @@ endif
 CPPFLAGS = -DVERSION=\"${VERSION}\" -D_POSIX_C_SOURCE=200809L ${CONFIG_OPTS}
 CFLAGS   = -mtune=native -march=native -std=c99 -pedantic -Wall -O3 ${INCS} ${CPPFLAGS}
 LDFLAGS  = -ggdb ${LIBS}
+# Library objects only export the AVOLT_API functions
+LIB_CFLAGS = -fPIC -fvisibility=hidden
 
 # Compiler and linker
 ifdef CLANG
@@ -4,6 +4,7 @@
 #include <strings.h>
 
 #include "alsa_utils.h"
+#include "mixer_trace.h"
 #include "wutil.h" // TODO: rename to util.h
 
 
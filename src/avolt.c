@@ -7,20 +7,53 @@
  */
 
 
-#include <alsa/asoundlib.h>
 #include <stdio.h>
-#include <strings.h>
+#include <stdlib.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #include "avolt.conf.h"
-#include "avolt.conf"
-#include "alsa_utils.h"
 #include "cmdline_options.h"
-#include "volume_change.h"
+#include "libavolt.h"
+#include "mixer_trace.h"
+#include "probes.h"
+#include "ptt.h"
+#include "stream.h"
+#include "transient.h"
 #include "wutil.h" // TODO: rename to util.h
 
 
+/* Asks from the user if the soft volume limit may be exceeded. Without a
+ * terminal, as under key bindings, or without an answer in time the soft
+ * limit policy is used. */
+static enum Soft_limit_policy confirm_from_stdin(
+        struct avolt_ctx* ctx,
+        struct sound_profile const* target,
+        long int new_vol,
+        void* data)
+{
+    struct avolt_config const* config = avolt_get_config(ctx);
+    if (!isatty(STDIN_FILENO) || config->soft_limit_confirm_timeout_ms <= 0)
+        return config->soft_limit_policy;
+
+    printf("Are you sure you want to set the main volume to %li? [N/y]: ",
+            new_vol);
+    fflush(stdout);
+
+    /* The terminal is line buffered, so stdin is readable after Enter */
+    struct pollfd fd = { .fd = STDIN_FILENO, .events = POLLIN };
+    char answer[16];
+    if (poll(&fd, 1, config->soft_limit_confirm_timeout_ms) <= 0 ||
+            !fgets(answer, sizeof(answer), stdin)) {
+        printf("\n");
+        return config->soft_limit_policy;
+    }
+    return answer[0] == 'y' ? soft_limit_apply : soft_limit_reject;
+}
+
+
 /*****************************************************************************
  * Main function
  * */
@@ -33,160 +66,147 @@ int main(const int argc, const char* argv[])
         .toggle_vol = 0,
         .toggle_output = false,
         .inc = false,
-        .verbose_level = 0
+        .verbose_level = 0,
+        .save_snapshot = NULL,
+        .restore_snapshot = NULL,
+        .record_trace = NULL,
+        .analyze_transients = false,
+        .stream = false,
+        .stream_path = NULL,
+        .ptt = false,
+        .ptt_profile = NULL,
+        .mic = false,
+        .mic_gain = INT_MAX
     };
 
 
+    AVOLT_PROBE_PHASE("options");
+
     /* Read parameters to cmd_opt */
     if (!read_cmd_line_options(argc, argv, &cmd_opt)) return 1;
 
-    /* Create needed variables */
-    snd_mixer_t* handle = get_handle();
-    if (!init_sound_profiles(handle)) {
+    /* Start recording before any mixer calls are made */
+    if (cmd_opt.record_trace &&
+            !mixer_trace_start(cmd_opt.record_trace, argc, argv))
+        return 1;
+
+    /* Open mixer and initialize the sound profiles */
+    AVOLT_PROBE_PHASE("open");
+    struct avolt_ctx* ctx = avolt_open();
+    if (!ctx) {
         fprintf(stderr, "Error: no sound profiles could be initialized.\n");
         return EXIT_FAILURE;
     }
-
-    /* First we must determine witch profile is "on" */
-    struct sound_profile* current_sp = get_current_sound_profile();
-
-    // TODO: Refactor as func (to alsa_utils module?)
-    /* First do the possible output profile change */
-    if (cmd_opt.toggle_output) {
-        PD_M("Toggling the output.\n");
-
-        struct sound_profile* target_sp = get_target_sound_profile(current_sp);
-
-        // For now this code doesn't work if profiles and given volume types
-        // differ // TOOD: fix sometime
-        assert(VOLUME_TYPE == target_sp->volume_type);
-
-        long int current_vol = -1;
-        get_vol(current_sp->volume_cntrl_mixer_element, target_sp->volume_type, &current_vol);
-
-
-        /* Check if no new volume given */
-        if (cmd_opt.new_vol == INT_MAX) {
-            /* Check if default volume is to be set */
-            if (target_sp->set_default_volume) {
-                PD_M("Setting the default volume.\n");
-                cmd_opt.new_vol = target_sp->default_volume;
-            }
-            else { // Else no volume change
-                cmd_opt.new_vol = current_vol;
-            }
+    avolt_set_confirm_callback(ctx, confirm_from_stdin, NULL);
+
+    int ret = 0;
+    if (cmd_opt.save_snapshot || cmd_opt.restore_snapshot) {
+        /* Snapshots are handled on their own */
+        AVOLT_PROBE_PHASE("snapshot");
+        int writes = 0;
+        if (cmd_opt.save_snapshot &&
+                !avolt_save_snapshot(ctx, cmd_opt.save_snapshot))
+            ret = 1;
+        else if (cmd_opt.restore_snapshot &&
+                !avolt_restore_snapshot(ctx, cmd_opt.restore_snapshot, &writes))
+            ret = 1;
+        else if (cmd_opt.restore_snapshot && cmd_opt.verbose_level > 0)
+            printf("Restored snapshot with %i writes\n", writes);
+    }
+    else if (cmd_opt.stream) {
+        /* Runs until end of the stream */
+        AVOLT_PROBE_PHASE("stream");
+        if (!run_volume_stream(ctx, cmd_opt.stream_path,
+                    cmd_opt.verbose_level > 0))
+            ret = 1;
+    }
+    else if (cmd_opt.ptt) {
+        /* Runs until end of input */
+        AVOLT_PROBE_PHASE("ptt");
+        if (!run_push_to_talk(ctx, cmd_opt.ptt_profile,
+                    cmd_opt.verbose_level > 0))
+            ret = 1;
+    }
+    else if (cmd_opt.mic) {
+        AVOLT_PROBE_PHASE("mic");
+        long int gain = 0;
+        bool active = false;
+        if (!avolt_get_capture_profile(ctx, NULL)) {
+            fprintf(stderr, "avolt ERROR: No capture profile available.\n");
+            ret = 1;
         }
-
-        assert(cmd_opt.new_vol != INT_MAX);
-
-        /* Check volume limit if setting new volume */
-        if (target_sp->confirm_exceeding_volume_limit &&
-                cmd_opt.new_vol > target_sp->soft_limit_volume) {
-            printf("Are you sure you want to set the main volume to %i? [N/y]: ",
-                    cmd_opt.new_vol);
-            if (fgetc(stdin) != 'y')
-                cmd_opt.new_vol = target_sp->default_volume;
+        else if (cmd_opt.mic_gain != INT_MAX) {
+            if (!avolt_set_capture_gain(ctx, NULL, cmd_opt.mic_gain))
+                ret = 1;
         }
-
-        /* If setting to a lower volume set volume before switching element to avoid volume spikes */
-        //if (!cmd_opt.inc && current_sp->volume_cntrl_mixer_element == target_sp->volume_cntrl_mixer_element && current_vol > cmd_opt.new_vol) {
-        if (current_sp->volume_cntrl_mixer_element == target_sp->volume_cntrl_mixer_element &&
-                cmd_opt.new_vol != current_vol) {
-            //PD_M("PRE setting volume to zero during output element switch: %i\n", cmd_opt.new_vol);
-            PD_M("PRE setting volume to zero during output element switch.\n");
-            bool ret = set_new_volume(
-                    target_sp,
-                    0,
-                    false,
-                    cmd_opt.set_default_vol,
-                    false,
-                    USE_SEMAPHORE,
-                    VOLUME_TYPE);
-            if (!ret) return 1;
-
-            // Sleep here to avoid volume spikes
-            nsleep(1000000);
-
-            // If new_vol is relative we need to calculate new new_vol value
-            if (cmd_opt.new_vol < 0 || cmd_opt.inc) {
-                cmd_opt.new_vol += current_vol;
-            }
-            current_vol = 0;
+        else if (avolt_get_capture_gain(ctx, NULL, &gain) &&
+                avolt_get_capture_active(ctx, NULL, &active)) {
+            printf("%li", gain);
+            if (cmd_opt.verbose_level > 0)
+                printf(" Capture: %s", active ? "on" : "off");
+            printf("\n");
         }
-
-        /* Turn on/off the outputs */
-        int err;
-        /* Check if target_sp has a dependency with current_sp */
-        if (current_sp->mixer_element != target_sp->volume_cntrl_mixer_element) {
-            /* If not switch current_sp off */
-            PD_M("switching off element: %s\n", current_sp->mixer_element_name);
-            err = snd_mixer_selem_set_playback_switch_all(current_sp->mixer_element, false);
-            if (err) printf("Error occured when toggling off current_sp mixer_element named: %s\n", current_sp->mixer_element_name);
+        else {
+            ret = 1;
         }
-
-        /* Switch target's mixer element on */
-        err = snd_mixer_selem_set_playback_switch_all(target_sp->mixer_element, true);
-        if (err) printf("Error occured when toggling off current_sp mixer_element named: %s\n", current_sp->mixer_element_name);
-
-        /* Print verbose info if no error occured while toggling playback switch */
-        if (!err) {
+    }
+    else if (cmd_opt.toggle_output) {
+        /* Output profile change, includes the possible volume change */
+        PD_M("Toggling the output.\n");
+        AVOLT_PROBE_PHASE("toggle_output");
+        /* Analysis samples the outputs around the whole toggle, the output
+         * is left alone if it can't be done */
+        bool const analyze = cmd_opt.analyze_transients;
+        if (analyze && !transient_start(ctx)) {
+            avolt_close(ctx);
+            return EXIT_FAILURE;
+        }
+        bool const toggled = avolt_toggle_output(ctx, cmd_opt.new_vol,
+                cmd_opt.inc, cmd_opt.set_default_vol, cmd_opt.toggle_vol);
+        if (analyze) transient_stop(stdout);
+        if (!toggled) {
+            printf("Errors occured while on/offing the output.\n");
+            ret = 1;
+        }
+        else if (avolt_get_profile(ctx)) {
+            struct sound_profile const* sp = avolt_get_profile(ctx);
             if (cmd_opt.verbose_level > 0)
-                printf("Current profile: %s\n", target_sp->mixer_element_name);
-            if (cmd_opt.verbose_level > 1) {
-                if (get_mixer_front_panel_switch())
-                    print_profile(&FRONT_PANEL, "", stdout);
-                else
-                    print_profile(&DEFAULT, "", stdout);
-            }
+                printf("Current profile: %s\n", sp->mixer_element_name);
+            if (cmd_opt.verbose_level > 1)
+                print_profile(sp, "", stdout);
         }
-
-        if (err) { printf("Errors occured while on/offing the output.\n"); return err; }
-
-        /* Exit if nothing else to do */
-        if ( (cmd_opt.new_vol == INT_MAX && !cmd_opt.toggle_vol) ||
-                (current_vol == cmd_opt.new_vol &&
-                 current_sp->volume_cntrl_mixer_element == target_sp->volume_cntrl_mixer_element) ) return err;
-    } // End of toggle_output
-
-    /* Second do the possible volume change */
-    /* If new volume given or toggle volume, or set default volume */
-    if (cmd_opt.new_vol != INT_MAX ||
+    }
+    else if (cmd_opt.new_vol != INT_MAX ||
             cmd_opt.toggle_vol ||
             cmd_opt.set_default_vol) {
-
-        bool ret = set_new_volume(
-                current_sp,
-                cmd_opt.new_vol,
-                cmd_opt.inc,
-                cmd_opt.set_default_vol,
-                cmd_opt.toggle_vol,
-                USE_SEMAPHORE,
-                VOLUME_TYPE);
-        if (!ret) return 1;
+        /* If new volume given or toggle volume, or set default volume */
+        AVOLT_PROBE_PHASE("change_volume");
+        if (!avolt_change_volume(ctx, cmd_opt.new_vol, cmd_opt.inc,
+                    cmd_opt.set_default_vol, cmd_opt.toggle_vol))
+            ret = 1;
     } else {
-
         /* default action: get % volumes */
+        AVOLT_PROBE_PHASE("get_volume");
         long int percent_vol = 0;
-        /* Get given profile volume range */
-        long int min, max;
-        snd_mixer_selem_get_playback_volume_range(current_sp->volume_cntrl_mixer_element, &min, &max);
-        PD_M("Current volume range is [%li, %li]\n", min, max);
-
-        get_vol(current_sp->volume_cntrl_mixer_element, VOLUME_TYPE, &percent_vol);
+        struct sound_profile const* sp = avolt_get_profile(ctx);
+        if (!sp || !avolt_get_volume(ctx, &percent_vol)) {
+            fprintf(stderr, "avolt ERROR: No sound profile is in use.\n");
+            avolt_close(ctx);
+            return EXIT_FAILURE;
+        }
         PD_M("Got volume from mixer element: %li\n", percent_vol);
 
         printf("%li", percent_vol);
         if (cmd_opt.verbose_level > 0)
             printf(" Front panel: %s",
-                    get_mixer_front_panel_switch() ? "on" : "off");
+                    get_mixer_front_panel_switch(avolt_get_config(ctx)) ? "on" : "off");
         printf("\n");
-        if (cmd_opt.verbose_level > 1) {
-            if (get_mixer_front_panel_switch())
-                print_profile(&FRONT_PANEL, "", stdout);
-            else
-                print_profile(&DEFAULT, "", stdout);
-        }
+        if (cmd_opt.verbose_level > 1)
+            print_profile(sp, "", stdout);
     }
 
-    return 0;
+    AVOLT_PROBE_PHASE("close");
+    avolt_close(ctx);
+    AVOLT_PROBE_PHASE("exit");
+    return ret;
 }
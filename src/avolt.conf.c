@@ -1,10 +1,13 @@
 // -*- coding: utf-8 -*- vim:fenc=utf-8:ft=c
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <strings.h>
 
 #include "avolt.conf.h"
 #include "alsa_utils.h"
+#include "mixer_trace.h"
 #include "wutil.h"
 
 /* Program configuration */
@@ -13,36 +16,146 @@
 
 static const char *Volume_type_to_str[] = {"alsa percentage", "hardware percentage",
      "hardware", "decibels"};
+static const char *Soft_limit_policy_to_str[] = {"apply", "clamp to the soft limit",
+     "set the default volume"};
 
-/* Initializes all sound profiles from SOUND_PROFILES array.
+/* Loads the statically set configuration to given config. Profiles are
+ * copied so that the config can be initialized and used independently of
+ * other configs.
+ * Returns false on allocation failure. */
+bool load_default_config(struct avolt_config* config)
+{
+    config->profiles = calloc(SOUND_PROFILES_SIZE, sizeof(struct sound_profile));
+    config->toggle_profiles = calloc(TOGGLE_SOUND_PROFILES_SIZE, sizeof(int));
+    config->capture_profiles = calloc(CAPTURE_PROFILES_SIZE, sizeof(struct capture_profile));
+    if (!config->profiles || !config->toggle_profiles || !config->capture_profiles) {
+        free_config(config);
+        return false;
+    }
+
+    config->profiles_size = SOUND_PROFILES_SIZE;
+    for (int i = 0; i < SOUND_PROFILES_SIZE; ++i) {
+        struct sound_profile* sp = &config->profiles[i];
+        *sp = *SOUND_PROFILES[i];
+
+        /* Group members get their own copy as their elements are resolved
+         * per config */
+        if (sp->volume_group_size > 0) {
+            size_t const size = sp->volume_group_size * sizeof(struct volume_group_member);
+            sp->volume_group = malloc(size);
+            if (!sp->volume_group) {
+                sp->volume_group_size = 0;
+                free_config(config);
+                return false;
+            }
+            memcpy(sp->volume_group, SOUND_PROFILES[i]->volume_group, size);
+        }
+        else {
+            sp->volume_group = NULL;
+        }
+    }
+
+    /* Toggle profiles are stored as indices to the copied profiles */
+    config->toggle_profiles_size = 0;
+    for (int i = 0; i < TOGGLE_SOUND_PROFILES_SIZE; ++i) {
+        for (int j = 0; j < SOUND_PROFILES_SIZE; ++j) {
+            if (TOGGLE_SOUND_PROFILES[i] == SOUND_PROFILES[j])
+                config->toggle_profiles[config->toggle_profiles_size++] = j;
+        }
+    }
+
+    config->capture_profiles_size = CAPTURE_PROFILES_SIZE;
+    for (int i = 0; i < CAPTURE_PROFILES_SIZE; ++i) {
+        config->capture_profiles[i] = *CAPTURE_PROFILES[i];
+    }
+
+    config->volume_type = VOLUME_TYPE;
+    config->use_semaphore = USE_SEMAPHORE;
+    config->settle_timeout_min_ms = SETTLE_TIMEOUT_MIN_MS;
+    config->settle_timeout_max_ms = SETTLE_TIMEOUT_MAX_MS;
+    config->soft_limit_policy = SOFT_LIMIT_POLICY;
+    config->soft_limit_confirm_timeout_ms = SOFT_LIMIT_CONFIRM_TIMEOUT_MS;
+    config->transient_sample_rate_hz = TRANSIENT_SAMPLE_RATE_HZ;
+    config->transient_tail_ms = TRANSIENT_TAIL_MS;
+    config->stream_frame_ms = STREAM_FRAME_MS;
+    config->post_change_hooks = POST_CHANGE_HOOKS;
+    config->hook_min_interval_ms = HOOK_MIN_INTERVAL_MS;
+    return true;
+}
+
+
+/* Frees memory allocated by load_default_config. */
+void free_config(struct avolt_config* config)
+{
+    for (int i = 0; i < config->profiles_size; ++i) {
+        free(config->profiles[i].volume_group);
+    }
+    free(config->profiles);
+    free(config->toggle_profiles);
+    free(config->capture_profiles);
+    config->profiles = NULL;
+    config->profiles_size = 0;
+    config->toggle_profiles = NULL;
+    config->toggle_profiles_size = 0;
+    config->capture_profiles = NULL;
+    config->capture_profiles_size = 0;
+}
+
+
+/* Initializes all sound profiles of the config from the given handle.
  * Returns true if at least one profile was successfully initialized. */
-bool init_sound_profiles(snd_mixer_t* handle)
+bool init_sound_profiles(snd_mixer_t* handle, struct avolt_config* config)
 {
     bool one_success = false;
-    for (int i = 0; i < SOUND_PROFILES_SIZE; ++i) {
-        PD_M("Initializing profile: %s\n", SOUND_PROFILES[i]->profile_name);
-        SOUND_PROFILES[i]->mixer_element = get_elem(handle, SOUND_PROFILES[i]->mixer_element_name);
-        if (SOUND_PROFILES[i]->mixer_element) {
-            SOUND_PROFILES[i]->init_ok = true;
+    for (int i = 0; i < config->profiles_size; ++i) {
+        struct sound_profile* sp = &config->profiles[i];
+        PD_M("Initializing profile: %s\n", sp->profile_name);
+        sp->mixer_element = get_elem(handle, sp->mixer_element_name);
+        if (sp->mixer_element) {
+            sp->init_ok = true;
         }
-        if (SOUND_PROFILES[i]->volume_cntrl_mixer_element_name) {
-            SOUND_PROFILES[i]->volume_cntrl_mixer_element = get_elem(handle, SOUND_PROFILES[i]->volume_cntrl_mixer_element_name);
-            if (SOUND_PROFILES[i]->volume_cntrl_mixer_element == NULL) {
-                SOUND_PROFILES[i]->init_ok = false;
+        if (sp->volume_cntrl_mixer_element_name) {
+            sp->volume_cntrl_mixer_element = get_elem(handle, sp->volume_cntrl_mixer_element_name);
+            if (sp->volume_cntrl_mixer_element == NULL) {
+                sp->init_ok = false;
             }
         }
         else {
-            SOUND_PROFILES[i]->volume_cntrl_mixer_element_name = SOUND_PROFILES[i]->mixer_element_name;
-            SOUND_PROFILES[i]->volume_cntrl_mixer_element = SOUND_PROFILES[i]->mixer_element;
+            sp->volume_cntrl_mixer_element_name = sp->mixer_element_name;
+            sp->volume_cntrl_mixer_element = sp->mixer_element;
+        }
+
+        /* Missing group members are skipped, they don't fail the profile */
+        for (int j = 0; j < sp->volume_group_size; ++j) {
+            struct volume_group_member* m = &sp->volume_group[j];
+            m->mixer_element = get_elem(handle, m->mixer_element_name);
         }
 
         // Check if profile initialization was successful
-        if (SOUND_PROFILES[i]->init_ok) {
-            PD_M("Initializing profile: '%s' ..successful\n", SOUND_PROFILES[i]->profile_name);
+        if (sp->init_ok) {
+            PD_M("Initializing profile: '%s' ..successful\n", sp->profile_name);
             one_success = true;
         }
     }
 
+    /* Capture profiles are optional, they don't count as success */
+    for (int i = 0; i < config->capture_profiles_size; ++i) {
+        struct capture_profile* cp = &config->capture_profiles[i];
+        cp->mixer_element = get_elem(handle, cp->mixer_element_name);
+        if (cp->switch_mixer_element_name) {
+            cp->switch_mixer_element = get_elem(handle, cp->switch_mixer_element_name);
+        }
+        else {
+            cp->switch_mixer_element_name = cp->mixer_element_name;
+            cp->switch_mixer_element = cp->mixer_element;
+        }
+        cp->init_ok = cp->mixer_element && cp->switch_mixer_element &&
+            snd_mixer_selem_has_capture_volume(cp->mixer_element) &&
+            snd_mixer_selem_has_capture_switch(cp->switch_mixer_element);
+        PD_M("Initializing capture profile: '%s' ..%s\n", cp->profile_name,
+                cp->init_ok ? "successful" : "failed");
+    }
+
     return one_success;
 }
 
@@ -60,6 +173,15 @@ void print_config(FILE* output)
     for (int i = 0; i < SOUND_PROFILES_SIZE; ++i) {
         print_profile(SOUND_PROFILES[i], indent, output);
     }
+    fprintf(output,
+            "Capture profiles:\n");
+    for (int i = 0; i < CAPTURE_PROFILES_SIZE; ++i) {
+        print_capture_profile(CAPTURE_PROFILES[i], indent, output);
+    }
+    fprintf(output,
+            "Unconfirmed soft limit exceeding (after %i ms or without a "
+            "terminal): %s\n", SOFT_LIMIT_CONFIRM_TIMEOUT_MS,
+            Soft_limit_policy_to_str[SOFT_LIMIT_POLICY]);
     if (USE_SEMAPHORE)
         fprintf(output,
             "Using semaphore named '%s' to prevent concurrent volume "
@@ -101,55 +223,142 @@ void print_profile(
             indent, indent,
             profile->confirm_exceeding_volume_limit
            );
+    for (int i = 0; i < profile->volume_group_size; ++i) {
+        struct volume_group_member const* m = &profile->volume_group[i];
+        fprintf(output,
+                "%s%sVolume group member: %s (volume * %g %+i, %s)\n",
+                indent, indent,
+                m->mixer_element_name,
+                m->scale,
+                m->offset,
+                Volume_type_to_str[m->volume_type]);
+    }
+}
+
+
+/* Print capture profile info */
+void print_capture_profile(
+        struct capture_profile const* profile,
+        char const* indent,
+        FILE* output)
+{
+    fprintf(output,
+            "%sName: %s\n"
+            "%s%sMixer element name: %s\n"
+            "%s%sCapture switch mixer element name: %s\n"
+            "%s%sDefault gain: %i\n"
+            "%s%sPush-to-talk toggles: %s\n",
+            indent,
+            profile->profile_name,
+            indent, indent,
+            profile->mixer_element_name,
+            indent, indent,
+            (profile->switch_mixer_element_name ?
+            profile->switch_mixer_element_name : "Same as mixer element."),
+            indent, indent,
+            profile->default_gain,
+            indent, indent,
+            profile->ptt_mode == ptt_switch ? "capture switch" : "gain");
 }
 
 
-/* Gets the current sound profile in use */
-struct sound_profile* get_current_sound_profile()
+/* Gets the current sound profile in use: the profile with its mixer element
+ * switched on, preferring profiles whose separate volume control element is
+ * also on. Without switched on profiles the first profile whose mixer element
+ * has no playback switch is in use.
+ * Returns NULL if no profile is in use. */
+struct sound_profile* get_current_sound_profile(struct avolt_config const* config)
 {
     struct sound_profile* current = NULL;
-    for (int i = 0; i < SOUND_PROFILES_SIZE; ++i) {
+    struct sound_profile* switchless = NULL;
+    for (int i = 0; i < config->profiles_size; ++i) {
+        struct sound_profile* sp = &config->profiles[i];
         // Skip sound profiles which have not been successfully installed.
-        if (!SOUND_PROFILES[i]->init_ok) {
+        if (!sp->init_ok) {
             continue;
         }
 
-        snd_mixer_elem_t* e = SOUND_PROFILES[i]->mixer_element;
-        if (snd_mixer_selem_has_playback_switch(e) &&
-                is_mixer_elem_playback_switch_on(e)) {
+        snd_mixer_elem_t* e = sp->mixer_element;
+        if (!snd_mixer_selem_has_playback_switch(e)) {
+            if (!switchless) switchless = sp;
+        }
+        else if (is_mixer_elem_playback_switch_on(e)) {
             if (!current || (
-                        strcmp(SOUND_PROFILES[i]->volume_cntrl_mixer_element_name, SOUND_PROFILES[i]->mixer_element_name) != 0 &&
-                        is_mixer_elem_playback_switch_on(SOUND_PROFILES[i]->volume_cntrl_mixer_element)))
-                    current = SOUND_PROFILES[i];
+                        strcmp(sp->volume_cntrl_mixer_element_name, sp->mixer_element_name) != 0 &&
+                        is_mixer_elem_playback_switch_on(sp->volume_cntrl_mixer_element)))
+                    current = sp;
         }
     }
 
-    assert(current);
-    return current;
+    return current ? current : switchless;
 }
 
 
-/* Gets target sound profile from TOGGLE_SOUND_PROFILES array */
-struct sound_profile* get_target_sound_profile(struct sound_profile* current)
+/* Gets target sound profile from the toggle profiles of the config: the
+ * next initialized profile after current in the toggle order, or the first
+ * one if current is NULL or not toggled.
+ * Returns NULL if there is no other initialized toggle profile. */
+struct sound_profile* get_target_sound_profile(
+        struct avolt_config const* config,
+        struct sound_profile* current)
 {
-    struct sound_profile* target = NULL;
-    for (int i = 0; i < TOGGLE_SOUND_PROFILES_SIZE; ++i) {
-        snd_mixer_elem_t* e = TOGGLE_SOUND_PROFILES[i]->mixer_element;
-        if (strcasecmp(snd_mixer_selem_get_name(current->mixer_element),
-                snd_mixer_selem_get_name(e)) == 0) {
-            target = i+1 < TOGGLE_SOUND_PROFILES_SIZE ? TOGGLE_SOUND_PROFILES[i+1] : TOGGLE_SOUND_PROFILES[0];
-        }
+    int const size = config->toggle_profiles_size;
+    int position = -1;
+    for (int i = 0; i < size && current; ++i) {
+        struct sound_profile const* sp = &config->profiles[config->toggle_profiles[i]];
+        if (sp->init_ok &&
+                strcasecmp(snd_mixer_selem_get_name(current->mixer_element),
+                    snd_mixer_selem_get_name(sp->mixer_element)) == 0)
+            position = i;
+    }
+
+    for (int i = 1; i <= size; ++i) {
+        struct sound_profile* sp =
+            &config->profiles[config->toggle_profiles[(position + i) % size]];
+        if (sp->init_ok && sp != current)
+            return sp;
     }
+    return NULL;
+}
 
-    assert(target);
-    return target;
+
+/* Gets sound profile with the given name from the config.
+ * Returns NULL if there is no initialized profile with the name. */
+struct sound_profile* get_sound_profile_by_name(
+        struct avolt_config const* config,
+        char const* name)
+{
+    for (int i = 0; i < config->profiles_size; ++i) {
+        if (config->profiles[i].init_ok &&
+                strcasecmp(config->profiles[i].profile_name, name) == 0)
+            return &config->profiles[i];
+    }
+    return NULL;
+}
+
+
+/* Gets capture profile with the given name, or the first initialized one if
+ * name is NULL.
+ * Returns NULL if there is no such initialized capture profile. */
+struct capture_profile* get_capture_profile_by_name(
+        struct avolt_config const* config,
+        char const* name)
+{
+    for (int i = 0; i < config->capture_profiles_size; ++i) {
+        struct capture_profile* cp = &config->capture_profiles[i];
+        if (cp->init_ok &&
+                (!name || strcasecmp(cp->profile_name, name) == 0))
+            return cp;
+    }
+    return NULL;
 }
 
 
-/* Gets mixer front panels switch value (on/off).
+/* Gets mixer front panels switch value (on/off) in the config.
  * Returns true for "on" and false for "off". */
-bool get_mixer_front_panel_switch()
+bool get_mixer_front_panel_switch(struct avolt_config const* config)
 {
-    return FRONT_PANEL.init_ok ?
-        is_mixer_elem_playback_switch_on(FRONT_PANEL.mixer_element) : false;
+    struct sound_profile const* sp =
+        get_sound_profile_by_name(config, FRONT_PANEL.profile_name);
+    return sp ? is_mixer_elem_playback_switch_on(sp->mixer_element) : false;
 }
@@ -4,6 +4,14 @@
 #include <alsa/asoundlib.h>
 #include <stdbool.h>
 
+/* Marks the functions exported from libavolt.so, which is built with hidden
+ * visibility */
+#if defined(__GNUC__) && !defined(AVOLT_API)
+#define AVOLT_API __attribute__((visibility("default")))
+#elif !defined(AVOLT_API)
+#define AVOLT_API
+#endif
+
 /* Different presentations for the volume */
 enum Volume_type {
     alsa_percentage,        // Volume converted with alsa default algorithm to 0-100 range.
@@ -16,6 +24,29 @@ enum Volume_type {
 };
 
 
+/* What is done to a volume exceeding the soft limit of a profile */
+enum Soft_limit_policy {
+    soft_limit_apply,       // Volume is set as given.
+    soft_limit_clamp,       // Soft limit volume of the profile is set.
+    soft_limit_reject,      // Default volume of the profile is set.
+};
+
+
+/* Mixer element which follows the volume of a sound profile */
+struct volume_group_member
+{
+    char* mixer_element_name;
+    snd_mixer_elem_t* mixer_element;
+
+    /* Member volume is profile volume * scale + offset, with the profile
+     * volume converted to the volume type of the member. When the profile
+     * volume is set to its minimum the member is set to its minimum too. */
+    double scale;
+    int offset;
+    enum Volume_type volume_type;
+};
+
+
 /* Alsa mixer element config */
 struct sound_profile
 {
@@ -33,10 +64,70 @@ struct sound_profile
     bool set_default_volume;
     bool confirm_exceeding_volume_limit;
 
+    /* Elements set together with the volume control element */
+    struct volume_group_member* volume_group;
+    int volume_group_size;
+
+    bool init_ok;
+};
+
+/* How push-to-talk opens and closes the microphone */
+enum Ptt_mode {
+    ptt_switch,             // Capture switch on/off, gain is left as is.
+    ptt_gain,               // Gain between 0 and default gain, switch kept on.
+};
+
+/* Alsa capture element config */
+struct capture_profile
+{
+    char* profile_name;
+
+    /* Capture element whose gain is controlled */
+    char* mixer_element_name;
+    snd_mixer_elem_t* mixer_element;
+
+    /* Element with the capture switch, same as mixer element if not given */
+    char* switch_mixer_element_name;
+    snd_mixer_elem_t* switch_mixer_element;
+
+    int default_gain;           // Alsa percentage.
+    enum Ptt_mode ptt_mode;
+
     bool init_ok;
 };
 
-bool init_sound_profiles(snd_mixer_t* handle);
+/* Runtime configuration, loaded from the static program configuration */
+struct avolt_config
+{
+    struct sound_profile* profiles;
+    int profiles_size;
+
+    /* Indices to profiles which can be toggled with toggle output, in
+     * toggling order. */
+    int* toggle_profiles;
+    int toggle_profiles_size;
+
+    struct capture_profile* capture_profiles;
+    int capture_profiles_size;
+
+    enum Volume_type volume_type;       // Volume type for given volumes.
+    bool use_semaphore;                 // See USE_SEMAPHORE in config.mk.
+    int settle_timeout_min_ms;
+    int settle_timeout_max_ms;
+    enum Soft_limit_policy soft_limit_policy; // Unanswered confirmations.
+    int soft_limit_confirm_timeout_ms;
+    int transient_sample_rate_hz;       // Output toggle analysis, see transient.h.
+    int transient_tail_ms;
+    int stream_frame_ms;                // Delta summing frame, see stream.h.
+    char const* const* post_change_hooks; // NULL terminated, see hooks.h.
+    int hook_min_interval_ms;
+};
+
+AVOLT_API bool load_default_config(struct avolt_config* config);
+
+AVOLT_API void free_config(struct avolt_config* config);
+
+bool init_sound_profiles(snd_mixer_t* handle, struct avolt_config* config);
 
 void print_config(FILE* output);
 
@@ -45,11 +136,26 @@ void print_profile(
         char const* indent,
         FILE* output);
 
-struct sound_profile* get_current_sound_profile();
+void print_capture_profile(
+        struct capture_profile const* profile,
+        char const* indent,
+        FILE* output);
+
+struct sound_profile* get_current_sound_profile(
+        struct avolt_config const* config);
 
 struct sound_profile* get_target_sound_profile(
+        struct avolt_config const* config,
         struct sound_profile* current);
 
-bool get_mixer_front_panel_switch();
+struct sound_profile* get_sound_profile_by_name(
+        struct avolt_config const* config,
+        char const* name);
+
+struct capture_profile* get_capture_profile_by_name(
+        struct avolt_config const* config,
+        char const* name);
+
+bool get_mixer_front_panel_switch(struct avolt_config const* config);
 
 #endif
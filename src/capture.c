@@ -0,0 +1,82 @@
+/* Capture gain and switch of capture profiles. Gains are in alsa
+ * percentage, like the alsa_percentage volume type. */
+#include <alsa/asoundlib.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "capture.h"
+#include "mixer_trace.h"
+#include "volume_mapping.h"
+#include "wutil.h"
+
+
+/* Gets gain of the first channel of the capture element. */
+bool get_capture_gain(struct capture_profile const* cp, long int* gain)
+{
+    long min, max;
+    if (snd_mixer_selem_get_capture_volume_range(cp->mixer_element, &min, &max) < 0)
+        return false;
+    *gain = lrint(get_normalized_capture_volume(cp->mixer_element,
+                SND_MIXER_SCHN_FRONT_LEFT) * 100);
+    return true;
+}
+
+
+/* Sets gain of all channels of the capture element. */
+bool set_capture_gain(struct capture_profile const* cp, long int gain)
+{
+    if (gain < 0) gain = 0;
+    if (gain > 100) gain = 100;
+
+    bool ret = true;
+    for (int ch = 0; ch <= SND_MIXER_SCHN_LAST; ++ch) {
+        if (!snd_mixer_selem_has_capture_channel(cp->mixer_element, ch)) continue;
+        int const err = set_normalized_capture_volume(cp->mixer_element, ch,
+                gain / 100.0, 0);
+        if (err) {
+            fprintf(stderr, "avolt ERROR: setting capture gain of '%s' failed: %s\n",
+                    cp->mixer_element_name, snd_strerror(err));
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+
+/* Gets whether the microphone is open in the push-to-talk sense of the
+ * profile: capture switch on, and for gain mode a nonzero gain. */
+bool get_capture_active(struct capture_profile const* cp, bool* active)
+{
+    int sw = 0;
+    if (snd_mixer_selem_get_capture_switch(cp->switch_mixer_element,
+                SND_MIXER_SCHN_FRONT_LEFT, &sw) < 0)
+        return false;
+
+    long int gain = 1;
+    if (cp->ptt_mode == ptt_gain && !get_capture_gain(cp, &gain))
+        return false;
+    *active = sw && gain > 0;
+    return true;
+}
+
+
+/* Opens or closes the microphone according to the push-to-talk mode of the
+ * profile. */
+bool set_capture_active(struct capture_profile const* cp, bool active)
+{
+    if (cp->ptt_mode == ptt_gain) {
+        /* Switch is turned on first so that the gain takes effect */
+        if (active &&
+                snd_mixer_selem_set_capture_switch_all(cp->switch_mixer_element, 1) < 0)
+            return false;
+        return set_capture_gain(cp, active ? cp->default_gain : 0);
+    }
+
+    int const err = snd_mixer_selem_set_capture_switch_all(cp->switch_mixer_element, active);
+    if (err < 0) {
+        fprintf(stderr, "avolt ERROR: toggling capture switch of '%s' failed: %s\n",
+                cp->switch_mixer_element_name, snd_strerror(err));
+        return false;
+    }
+    return true;
+}
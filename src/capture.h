@@ -0,0 +1,17 @@
+#ifndef CAPTURE_H_INCLUDED
+#define CAPTURE_H_INCLUDED
+
+#include <stdbool.h>
+
+#include "avolt.conf.h"
+
+
+bool get_capture_gain(struct capture_profile const* cp, long int* gain);
+
+bool set_capture_gain(struct capture_profile const* cp, long int gain);
+
+bool get_capture_active(struct capture_profile const* cp, bool* active);
+
+bool set_capture_active(struct capture_profile const* cp, bool active);
+
+#endif
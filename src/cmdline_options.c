@@ -10,6 +10,17 @@
 #include "avolt.conf.h"
 
 
+/* Checks if arg is a capture gain. A negative number is taken as a gain too
+ * (set_capture_gain clamps it to 0) rather than as a volume decrease. */
+static bool is_gain_arg(const char* arg)
+{
+    if (arg[0] != '-') return true;
+    char* end;
+    strtol(arg, &end, 10);
+    return end != arg && *end == '\0';
+}
+
+
 /* Reads cmd_line options to given options struct variable */
 bool read_cmd_line_options(
         const int argc,
@@ -17,12 +28,21 @@ bool read_cmd_line_options(
         struct cmd_options* cmd_opt)
 {
     const char* input_help = "[[-s] [+|-]<volume>]] [-t] [-to] [-v]"
+        " [--save|--restore <name>] [--record <file>] [--transients]"
+        " [--stream [<fifo>]] [--ptt [<capture profile>]] [--mic [<gain>]]"
         "\n\n"
         "Option help:\n"
         "v:\tBe more verbose.\n"
         "s:\tSet volume.\n"
         "t:\tToggle volume.\n"
-        "to:\tToggle output.\n";
+        "to:\tToggle output.\n"
+        "save:\tSave volumes, switches and profile to a named snapshot.\n"
+        "restore:\tRestore a named snapshot.\n"
+        "record:\tRecord mixer calls to a trace file (see avolt-replay).\n"
+        "transients:\tToggle output and report output level transients.\n"
+        "stream:\tRead relative volume deltas from stdin or a FIFO.\n"
+        "ptt:\tPush-to-talk with press/release lines from stdin.\n"
+        "mic:\tGet or set the default capture profile gain (0-100).\n";
 
     for (int i = 1; i < argc; i++) {
         if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc)) {
@@ -38,6 +58,27 @@ bool read_cmd_line_options(
             cmd_opt->toggle_output = true;
         } else if (strcmp(argv[i], "-tf") == 0) { // XXX: Depracated output toggling
             cmd_opt->toggle_output = true;
+        } else if ((strcmp(argv[i], "--save") == 0) && (i+1 < argc)) {
+            cmd_opt->save_snapshot = argv[++i];
+        } else if ((strcmp(argv[i], "--restore") == 0) && (i+1 < argc)) {
+            cmd_opt->restore_snapshot = argv[++i];
+        } else if ((strcmp(argv[i], "--record") == 0) && (i+1 < argc)) {
+            cmd_opt->record_trace = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            cmd_opt->stream = true;
+            if (i+1 < argc && argv[i+1][0] != '-')
+                cmd_opt->stream_path = argv[++i];
+        } else if (strcmp(argv[i], "--ptt") == 0) {
+            cmd_opt->ptt = true;
+            if (i+1 < argc && argv[i+1][0] != '-')
+                cmd_opt->ptt_profile = argv[++i];
+        } else if (strcmp(argv[i], "--mic") == 0) {
+            cmd_opt->mic = true;
+            if (i+1 < argc && is_gain_arg(argv[i+1]))
+                cmd_opt->mic_gain = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--transients") == 0) {
+            cmd_opt->analyze_transients = true;
+            cmd_opt->toggle_output = true;
         } else {
             get_vol_from_arg(argv[i], &cmd_opt->new_vol, &cmd_opt->inc);
             if (strcmp(argv[i], "0") != 0 &&
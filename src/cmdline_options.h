@@ -15,6 +15,16 @@ struct cmd_options
     bool toggle_output;         // Toggle output
     bool inc;                   // Do we increase volume
     int verbose_level;          // Verbosity level
+    char const* save_snapshot;  // Save mixer snapshot with this name
+    char const* restore_snapshot; // Restore mixer snapshot with this name
+    char const* record_trace;   // Record mixer calls to this file
+    bool analyze_transients;    // Sample output levels while toggling output
+    bool stream;                // Read volume deltas from stream_path
+    char const* stream_path;    // FIFO to read from, NULL for stdin
+    bool ptt;                   // Push-to-talk commands from stdin
+    char const* ptt_profile;    // Capture profile, NULL for the default
+    bool mic;                   // Get or set capture gain
+    int mic_gain;               // Set capture gain to this, or INT_MAX
 };
 
 
@@ -0,0 +1,230 @@
+/* Post-change hooks, see hooks.h. */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "hooks.h"
+#include "wutil.h"
+
+
+#define HOOK_ENV_SIZE 8
+#define HOOK_ENV_VALUE_SIZE 128
+
+
+extern char** environ;
+
+
+/* Checks from the stamp file if hooks may be started now, and if so
+ * updates the stamp. The stamp is locked so that concurrent avolt processes
+ * start hooks only once, a stamp locked by another process counts as not
+ * due. Without a usable stamp file hooks are always due.
+ * skipped_usec is the monotonic time of an earlier change for which hooks
+ * were not due, or 0 for a new change. Hooks started since then have seen
+ * that change, so it is no longer due.
+ * If hooks are not due, next_usec is set to the monotonic time at which to
+ * check again, or to 0 if there is nothing to check. */
+bool hooks_due(
+        struct avolt_config const* config,
+        long long skipped_usec,
+        long long* next_usec)
+{
+    *next_usec = 0;
+    if (!config->post_change_hooks || !config->post_change_hooks[0])
+        return false;
+    if (config->hook_min_interval_ms <= 0)
+        return true;
+
+    char path[PATH_MAX];
+    if (!get_user_file_path("XDG_RUNTIME_DIR", ".cache", "avolt", "hook-stamp",
+                path, sizeof(path)))
+        return true;
+    int const fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return true;
+
+    /* Monotonic time is shared by all processes of the boot */
+    long long const now = monotonic_usec();
+    long long const interval = config->hook_min_interval_ms * 1000LL;
+
+    struct flock lock = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+    if (fcntl(fd, F_SETLK, &lock) == -1) {
+        close(fd);
+        *next_usec = now + interval;
+        return false;
+    }
+
+    long long last = 0;
+    bool const stamped = pread(fd, &last, sizeof(last), 0) == sizeof(last) &&
+        last <= now;
+    bool due = false;
+    if (!stamped || skipped_usec == 0 || last < skipped_usec) {
+        due = !stamped || now - last >= interval;
+        if (!due) *next_usec = last + interval;
+    }
+
+    if (due && pwrite(fd, &now, sizeof(now), 0) != sizeof(now)) {
+        PD_M("Could not update hook stamp %s\n", path);
+    }
+
+    close(fd);  // Releases the lock.
+    return due;
+}
+
+
+/* Reaps exited hook processes without waiting for running ones. */
+void reap_hooks(struct hook_children* children)
+{
+    for (int i = 0; i < children->size; ) {
+        if (waitpid(children->pids[i], NULL, WNOHANG) != 0)
+            children->pids[i] = children->pids[--children->size];
+        else
+            ++i;
+    }
+}
+
+
+/* Reaps exited hook processes and frees the bookkeeping. Hooks still
+ * running are left for init once the process exits. */
+void release_hooks(struct hook_children* children)
+{
+    reap_hooks(children);
+    free(children->pids);
+    children->pids = NULL;
+    children->size = children->capacity = 0;
+}
+
+
+/* Adds started hook process to be reaped later */
+static void add_hook_child(struct hook_children* children, pid_t pid)
+{
+    if (children->size == children->capacity) {
+        int const capacity = children->capacity ? children->capacity * 2 : 8;
+        pid_t* pids = realloc(children->pids, capacity * sizeof(pid_t));
+        if (!pids) {
+            /* Can't be tracked, reap it now instead of leaving a zombie */
+            waitpid(pid, NULL, 0);
+            return;
+        }
+        children->pids = pids;
+        children->capacity = capacity;
+    }
+    children->pids[children->size++] = pid;
+}
+
+
+/* Starts the configured hooks with the given state, see hooks.h. Expects
+ * hooks_due to have been checked. Children exited so far are reaped. */
+void run_hooks(
+        struct avolt_config const* config,
+        struct hook_children* children,
+        char const* event,
+        struct sound_profile const* sp,
+        long int volume,
+        bool switch_on)
+{
+    reap_hooks(children);
+
+    /* Environment of avolt with the state variables prepended */
+    char values[HOOK_ENV_SIZE][HOOK_ENV_VALUE_SIZE];
+    snprintf(values[0], HOOK_ENV_VALUE_SIZE, "AVOLT_EVENT=%s", event);
+    snprintf(values[1], HOOK_ENV_VALUE_SIZE, "AVOLT_PROFILE=%s", sp->profile_name);
+    snprintf(values[2], HOOK_ENV_VALUE_SIZE, "AVOLT_ELEMENT=%s", sp->mixer_element_name);
+    snprintf(values[3], HOOK_ENV_VALUE_SIZE, "AVOLT_VOLUME=%li", volume);
+    snprintf(values[4], HOOK_ENV_VALUE_SIZE, "AVOLT_SWITCH=%i", switch_on);
+    int const values_size = 5;
+
+    size_t environ_size = 0;
+    while (environ && environ[environ_size]) ++environ_size;
+    char** envp = malloc((environ_size + values_size + 1) * sizeof(char*));
+    if (!envp) return;
+    size_t envp_size = 0;
+    for (int i = 0; i < values_size; ++i) envp[envp_size++] = values[i];
+    /* Inherited state variables, from hooks changing the volume for
+     * example, would duplicate the new ones */
+    for (size_t i = 0; i < environ_size; ++i) {
+        if (strncmp(environ[i], "AVOLT_", 6) != 0)
+            envp[envp_size++] = environ[i];
+    }
+    envp[envp_size] = NULL;
+
+    /* Hooks must not hold avolt's output open, callers reading it would wait
+     * for the hooks to exit */
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    for (char const* const* hook = config->post_change_hooks; *hook; ++hook) {
+        char* argv[] = { (char*)*hook, (char*)event, NULL };
+        pid_t pid;
+        int const err = posix_spawnp(&pid, *hook, &actions, NULL, argv, envp);
+        if (err) {
+            fprintf(stderr, "avolt ERROR: Could not start hook '%s': %s\n",
+                    *hook, strerror(err));
+            continue;
+        }
+        add_hook_child(children, pid);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    free(envp);
+}
+
+
+/* Starts the trailing round of hooks for the change made at skipped_usec
+ * (see hooks_due) from a detached process, which waits until the round is
+ * due and starts it with the given state. The caller, typically about to
+ * exit, does not wait for it. The process is forked, so sp must stay valid
+ * only until this returns. */
+void run_hooks_detached(
+        struct avolt_config const* config,
+        long long skipped_usec,
+        char const* event,
+        struct sound_profile const* sp,
+        long int volume,
+        bool switch_on)
+{
+    pid_t const pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "avolt ERROR: Could not start trailing hooks: %s\n",
+                strerror(errno));
+        return;
+    }
+    if (pid > 0) {
+        /* The intermediate child exits right away */
+        waitpid(pid, NULL, 0);
+        return;
+    }
+
+    /* Runner is orphaned to init, which reaps it and its hooks */
+    setsid();
+    if (fork() != 0) _exit(0);
+
+    /* Must not hold the output of the caller, nor its mixer, open */
+    int const null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+    }
+    long const max_fd = sysconf(_SC_OPEN_MAX);
+    for (int fd = STDERR_FILENO + 1; fd < max_fd && fd < 65536; ++fd)
+        close(fd);
+
+    long long next = 0;
+    while (!hooks_due(config, skipped_usec, &next)) {
+        if (!next) _exit(0);
+        long long const left = next - monotonic_usec();
+        if (left > 0) nsleep((long)left * 1000);
+    }
+    struct hook_children children = { .pids = NULL };
+    run_hooks(config, &children, event, sp, volume, switch_on);
+    _exit(0);
+}
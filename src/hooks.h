@@ -0,0 +1,63 @@
+#ifndef HOOKS_H_INCLUDED
+#define HOOKS_H_INCLUDED
+/* Post-change hooks.
+ *
+ * Hook programs are started with posix_spawnp after volume and profile
+ * changes, without waiting for them, with stdin, stdout and stderr connected
+ * to /dev/null. The first argument is the event name and the new state is
+ * given in environment variables:
+ *   AVOLT_EVENT     volume, profile or snapshot
+ *   AVOLT_PROFILE   name of the current profile
+ *   AVOLT_ELEMENT   mixer element of the current profile
+ *   AVOLT_VOLUME    volume in the configured volume type
+ *   AVOLT_SWITCH    1 if the profile mixer element is switched on, else 0
+ * Hooks are started at most once per minimum interval, shared by all avolt
+ * processes of the user through a stamp file. A change within the interval
+ * after a started hook does not start hooks right away, instead a trailing
+ * round is started with the state at the end of the interval, unless hooks
+ * started meanwhile by another process already saw the change (see
+ * hooks_due). A process exiting before its trailing round is due hands it
+ * to a detached process (run_hooks_detached) instead of waiting for it.
+ */
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "avolt.conf.h"
+
+
+/* Started hook processes not yet reaped */
+struct hook_children
+{
+    pid_t* pids;
+    int size;
+    int capacity;
+};
+
+
+bool hooks_due(
+        struct avolt_config const* config,
+        long long skipped_usec,
+        long long* next_usec);
+
+void run_hooks(
+        struct avolt_config const* config,
+        struct hook_children* children,
+        char const* event,
+        struct sound_profile const* sp,
+        long int volume,
+        bool switch_on);
+
+void run_hooks_detached(
+        struct avolt_config const* config,
+        long long skipped_usec,
+        char const* event,
+        struct sound_profile const* sp,
+        long int volume,
+        bool switch_on);
+
+void reap_hooks(struct hook_children* children);
+
+void release_hooks(struct hook_children* children);
+
+#endif
@@ -0,0 +1,900 @@
+/* Context based avolt interface, see libavolt.h. */
+#include <alsa/asoundlib.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <strings.h>
+#include <limits.h>   /* INT_MAX and so on */
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "libavolt.h"
+#include "alsa_utils.h"
+#include "capture.h"
+#include "hooks.h"
+#include "mixer_trace.h"
+#include "probes.h"
+#include "settle.h"
+#include "snapshot.h"
+#include "volume_change.h"
+#include "wutil.h"
+
+
+struct avolt_ctx
+{
+    pthread_mutex_t lock;       // Guards everything below.
+
+    snd_mixer_t* handle;
+    struct avolt_config config;
+    sem_t* sem;                 // Volume semaphore, NULL if not in use.
+
+    int epoll_fd;               // Aggregates the mixer poll descriptors.
+    bool event_pending;         // Profile element changed since last dispatch.
+
+    avolt_event_cb event_cb;
+    void* event_data;
+    avolt_confirm_cb confirm_cb;
+    void* confirm_data;
+
+    unsigned long* capture_events; // Value events per capture profile.
+
+    struct hook_children hook_children;
+    long long hook_skipped_usec; // Change hooks weren't due for, 0 if none.
+    char const* hook_skipped_event;
+    int hook_timer_fd;          // Expires when the skipped change is due.
+};
+
+
+/* Answer to a soft limit confirmation, holds only for the asked target and
+ * volume */
+struct soft_limit_answer
+{
+    struct sound_profile const* target;     // NULL if nothing was asked.
+    long int vol;
+    enum Soft_limit_policy policy;
+};
+
+
+/* Gets the element whose changes push-to-talk waits for */
+static snd_mixer_elem_t* get_ptt_elem(struct capture_profile const* cp)
+{
+    return cp->ptt_mode == ptt_gain ? cp->mixer_element : cp->switch_mixer_element;
+}
+
+
+/* Mixer element callback, marks the event for the dispatch and counts value
+ * changes of the capture profiles */
+static int on_elem_event(snd_mixer_elem_t* elem, unsigned int mask)
+{
+    struct avolt_ctx* ctx = snd_mixer_elem_get_callback_private(elem);
+    ctx->event_pending = true;
+    if (mask == SND_CTL_EVENT_MASK_REMOVE || !(mask & SND_CTL_EVENT_MASK_VALUE))
+        return 0;
+    for (int i = 0; i < ctx->config.capture_profiles_size; ++i) {
+        struct capture_profile const* cp = &ctx->config.capture_profiles[i];
+        if (cp->init_ok && get_ptt_elem(cp) == elem)
+            ++ctx->capture_events[i];
+    }
+    return 0;
+}
+
+
+/* Unlocks the context and calls the event callback if events are pending.
+ * The callback is called without the lock so that it can use the context. */
+static void unlock_and_dispatch(struct avolt_ctx* ctx)
+{
+    avolt_event_cb cb = ctx->event_pending ? ctx->event_cb : NULL;
+    void* data = ctx->event_data;
+    if (cb) ctx->event_pending = false;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (cb) cb(ctx, data);
+}
+
+
+/* Gets the current profile and its state for the hooks. Returns NULL if no
+ * profile is in use. */
+static struct sound_profile* get_hook_state(
+        struct avolt_ctx* ctx,
+        long int* vol,
+        bool* on)
+{
+    struct sound_profile* sp = get_current_sound_profile(&ctx->config);
+    if (!sp) return NULL;
+    *vol = 0;
+    get_vol(sp->volume_cntrl_mixer_element, ctx->config.volume_type, vol);
+    *on = !snd_mixer_selem_has_playback_switch(sp->mixer_element) ||
+        is_mixer_elem_playback_switch_on(sp->mixer_element);
+    return sp;
+}
+
+
+/* Starts the post-change hooks with the state of the current profile */
+static void start_hooks(struct avolt_ctx* ctx, char const* event)
+{
+    long int vol;
+    bool on;
+    struct sound_profile const* sp = get_hook_state(ctx, &vol, &on);
+    if (sp) run_hooks(&ctx->config, &ctx->hook_children, event, sp, vol, on);
+}
+
+
+/* Arms the hook timer to expire at the monotonic time at_usec */
+static void arm_hook_timer(struct avolt_ctx* ctx, long long at_usec)
+{
+    if (ctx->hook_timer_fd < 0) return;
+    struct itimerspec its = {
+        .it_value = {
+            .tv_sec = at_usec / 1000000,
+            .tv_nsec = at_usec % 1000000 * 1000 + 1  // Never disarms.
+        }
+    };
+    timerfd_settime(ctx->hook_timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+/* Starts the trailing round of hooks for a change they were not due for,
+ * once it is due. If detach is set, a round not due yet is handed to a
+ * detached process with the current state, otherwise the hook timer is
+ * armed for it. Expects the lock to be held. */
+static void run_skipped_hooks(struct avolt_ctx* ctx, bool detach)
+{
+    if (!ctx->hook_skipped_usec) return;
+    long long next = 0;
+    if (hooks_due(&ctx->config, ctx->hook_skipped_usec, &next)) {
+        ctx->hook_skipped_usec = 0;
+        start_hooks(ctx, ctx->hook_skipped_event);
+    }
+    else if (!next) {
+        ctx->hook_skipped_usec = 0;
+    }
+    else if (detach) {
+        long int vol;
+        bool on;
+        struct sound_profile const* sp = get_hook_state(ctx, &vol, &on);
+        if (sp) {
+            run_hooks_detached(&ctx->config, ctx->hook_skipped_usec,
+                    ctx->hook_skipped_event, sp, vol, on);
+        }
+        ctx->hook_skipped_usec = 0;
+    }
+    else {
+        arm_hook_timer(ctx, next);
+    }
+}
+
+
+/* Starts the post-change hooks with the state of the current profile if
+ * they are due, otherwise schedules a trailing round. Expects the lock to
+ * be held. */
+static void run_post_change_hooks(struct avolt_ctx* ctx, char const* event)
+{
+    long long next = 0;
+    if (hooks_due(&ctx->config, 0, &next)) {
+        /* Also covers any earlier skipped change */
+        ctx->hook_skipped_usec = 0;
+        start_hooks(ctx, event);
+    }
+    else if (next) {
+        ctx->hook_skipped_usec = monotonic_usec();
+        ctx->hook_skipped_event = event;
+        arm_hook_timer(ctx, next);
+    }
+}
+
+
+/* Registers event callbacks for the profile elements and adds mixer poll
+ * descriptors to the contexts epoll instance. */
+static bool init_events(struct avolt_ctx* ctx)
+{
+    for (int i = 0; i < ctx->config.profiles_size; ++i) {
+        struct sound_profile* sp = &ctx->config.profiles[i];
+        snd_mixer_elem_t* elems[] = {sp->mixer_element, sp->volume_cntrl_mixer_element};
+        for (size_t j = 0; j < sizeof(elems)/sizeof(elems[0]); ++j) {
+            if (!elems[j]) continue;
+            snd_mixer_elem_set_callback(elems[j], on_elem_event);
+            snd_mixer_elem_set_callback_private(elems[j], ctx);
+        }
+    }
+    for (int i = 0; i < ctx->config.capture_profiles_size; ++i) {
+        struct capture_profile* cp = &ctx->config.capture_profiles[i];
+        snd_mixer_elem_t* elems[] = {cp->mixer_element, cp->switch_mixer_element};
+        for (size_t j = 0; cp->init_ok && j < sizeof(elems)/sizeof(elems[0]); ++j) {
+            if (!elems[j]) continue;
+            snd_mixer_elem_set_callback(elems[j], on_elem_event);
+            snd_mixer_elem_set_callback_private(elems[j], ctx);
+        }
+    }
+
+    /* One extra so that the allocation is never zero sized */
+    ctx->capture_events = calloc(ctx->config.capture_profiles_size + 1,
+            sizeof(unsigned long));
+    if (!ctx->capture_events) return false;
+
+    ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctx->epoll_fd < 0) return false;
+
+    /* Trailing hooks are started from avolt_handle_events */
+    ctx->hook_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (ctx->hook_timer_fd < 0) return false;
+    struct epoll_event timer_ev = { .events = EPOLLIN, .data.fd = ctx->hook_timer_fd };
+    if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, ctx->hook_timer_fd, &timer_ev) != 0)
+        return false;
+
+    int nfds = snd_mixer_poll_descriptors_count(ctx->handle);
+    if (nfds <= 0) return nfds == 0;
+    struct pollfd fds[nfds];
+    nfds = snd_mixer_poll_descriptors(ctx->handle, fds, nfds);
+    for (int i = 0; i < nfds; ++i) {
+        struct epoll_event ev = {
+            .events = (fds[i].events & POLLIN ? EPOLLIN : 0) |
+                (fds[i].events & POLLOUT ? EPOLLOUT : 0),
+            .data.fd = fds[i].fd
+        };
+        if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, fds[i].fd, &ev) != 0)
+            return false;
+    }
+    return true;
+}
+
+
+/* Opens mixer of the default device and initializes the sound profiles from
+ * the program configuration.
+ * Returns NULL if no sound profile could be initialized. */
+struct avolt_ctx* avolt_open(void)
+{
+    struct avolt_config config;
+    if (!load_default_config(&config)) return NULL;
+    return avolt_open_config(&config);
+}
+
+
+/* Opens mixer of the default device with the given configuration, allocated
+ * like load_default_config does. The context takes over the configuration,
+ * it is freed with free_config also on failure.
+ * Returns NULL if no sound profile could be initialized. */
+struct avolt_ctx* avolt_open_config(struct avolt_config* config)
+{
+    struct avolt_ctx* ctx = calloc(1, sizeof(struct avolt_ctx));
+    if (!ctx) {
+        free_config(config);
+        return NULL;
+    }
+    ctx->epoll_fd = -1;
+    ctx->hook_timer_fd = -1;
+
+    ctx->config = *config;
+    pthread_mutex_init(&ctx->lock, NULL);
+
+    /* Opened once, every volume change of the context takes it */
+    if (config->use_semaphore && !(ctx->sem = open_semaphore())) {
+        avolt_close(ctx);
+        return NULL;
+    }
+
+    ctx->handle = get_handle();
+    if (!init_sound_profiles(ctx->handle, &ctx->config)) {
+        avolt_close(ctx);
+        return NULL;
+    }
+
+    if (!init_events(ctx)) {
+        fprintf(stderr, "avolt ERROR: Could not initialize mixer events.\n");
+        avolt_close(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+
+/* Closes the mixer and frees the context. The trailing round of hooks for
+ * a change made within the hook interval is left to a detached process. */
+void avolt_close(struct avolt_ctx* ctx)
+{
+    if (!ctx) return;
+    /* Trailing hooks can't be left to the timer anymore */
+    run_skipped_hooks(ctx, true);
+    release_hooks(&ctx->hook_children);
+    if (ctx->hook_timer_fd >= 0)
+        close(ctx->hook_timer_fd);
+    if (ctx->epoll_fd >= 0)
+        close(ctx->epoll_fd);
+    if (ctx->handle)
+        snd_mixer_close(ctx->handle);
+    if (ctx->sem)
+        sem_close(ctx->sem);
+    free(ctx->capture_events);
+    free_config(&ctx->config);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+}
+
+
+/* Gets volume of the current profile.
+ * Returns false if no profile is in use. */
+bool avolt_get_volume(struct avolt_ctx* ctx, long int* vol)
+{
+    pthread_mutex_lock(&ctx->lock);
+    struct sound_profile* sp = get_current_sound_profile(&ctx->config);
+    if (sp)
+        get_vol(sp->volume_cntrl_mixer_element, ctx->config.volume_type, vol);
+    unlock_and_dispatch(ctx);
+    return sp != NULL;
+}
+
+
+/* Changes volume of the current profile, see set_new_volume for the
+ * arguments. */
+bool avolt_change_volume(
+        struct avolt_ctx* ctx,
+        long int new_vol,
+        bool relative_inc,
+        bool set_default_vol,
+        bool toggle_vol)
+{
+    pthread_mutex_lock(&ctx->lock);
+    struct sound_profile* sp = get_current_sound_profile(&ctx->config);
+    bool ret = sp && set_new_volume(sp, new_vol, relative_inc, set_default_vol,
+            toggle_vol, ctx->sem, ctx->config.volume_type);
+    if (ret) run_post_change_hooks(ctx, "volume");
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Sets absolute volume, or if relative_inc or new_vol is negative, changes
+ * the volume relative to the current volume. */
+bool avolt_set_volume(
+        struct avolt_ctx* ctx,
+        long int new_vol,
+        bool relative_inc)
+{
+    return avolt_change_volume(ctx, new_vol, relative_inc, false, false);
+}
+
+
+/* Sets default volume of the current profile. */
+bool avolt_set_default_volume(struct avolt_ctx* ctx)
+{
+    return avolt_change_volume(ctx, 0, false, true, false);
+}
+
+
+/* Toggles volume between zero and new_vol, or the default volume of the
+ * current profile if new_vol is INT_MAX or negative. */
+bool avolt_toggle_volume(struct avolt_ctx* ctx, long int new_vol)
+{
+    return avolt_change_volume(ctx, new_vol, false, false, true);
+}
+
+
+/* Sets playback switch of all channels of the element. */
+static int set_switch(snd_mixer_elem_t* elem, bool on)
+{
+    AVOLT_PROBE_ENTRY(switch, elem, -1, probe_switch(elem), on);
+#ifdef D_AVOLT_USDT
+    int const old_switch = AVOLT_PROBE_ENABLED(switch_return) ?
+        probe_switch(elem) : -1;
+#endif
+    int err = snd_mixer_selem_set_playback_switch_all(elem, on);
+    AVOLT_PROBE_RETURN(switch, elem, -1, old_switch, probe_switch(elem), err);
+    return err;
+}
+
+
+/* Gets the volume switch_output sets for new_vol and sets vol_type to its
+ * volume type. Given volumes are in the configured volume type. If new_vol is
+ * INT_MAX the default volume of the target, in the volume type of the
+ * target, is used if the target profile has set_default_volume, else the
+ * volume is kept. current_sp is NULL if no output is on. */
+static long int resolve_output_volume(
+        struct avolt_ctx* ctx,
+        struct sound_profile const* current_sp,
+        struct sound_profile const* target_sp,
+        long int new_vol,
+        enum Volume_type* vol_type)
+{
+    *vol_type = ctx->config.volume_type;
+    if (new_vol != INT_MAX) return new_vol;
+
+    /* Check if default volume is to be set */
+    if (target_sp->set_default_volume) {
+        PD_M("Setting the default volume.\n");
+        *vol_type = target_sp->volume_type;
+        return target_sp->default_volume;
+    }
+    // Else no volume change
+    long int current_vol = -1;
+    get_vol(current_sp ? current_sp->volume_cntrl_mixer_element :
+            target_sp->volume_cntrl_mixer_element, *vol_type, &current_vol);
+    return current_vol;
+}
+
+
+/* Checks if vol of vol_type exceeds the soft limit of the profile. Relative
+ * volumes are resolved against the current volume of the profile, like
+ * set_new_volume does, and percentages kept in [0,100]. Volumes of different
+ * types are compared as hardware volumes of the profile. */
+static bool exceeds_soft_limit(
+        struct sound_profile const* sp,
+        long int vol,
+        enum Volume_type vol_type,
+        bool relative_inc)
+{
+    if (!sp->confirm_exceeding_volume_limit) return false;
+    if (relative_inc || vol < 0) {
+        long int current_vol = 0;
+        get_vol(sp->volume_cntrl_mixer_element, vol_type, &current_vol);
+        vol += current_vol;
+    }
+    if (vol_type == alsa_percentage || vol_type == hardware_percentage)
+        vol = vol < 0 ? 0 : vol > 100 ? 100 : vol;
+    if (vol_type == sp->volume_type) return vol > sp->soft_limit_volume;
+
+    long int hw_vol, hw_limit;
+    if (to_hw_vol(sp->volume_cntrl_mixer_element, vol_type, vol, 0, &hw_vol) != 0 ||
+            to_hw_vol(sp->volume_cntrl_mixer_element, sp->volume_type,
+                sp->soft_limit_volume, 0, &hw_limit) != 0)
+        return vol > sp->soft_limit_volume;
+    return hw_vol > hw_limit;
+}
+
+
+/* Asks the confirm callback what to do if switching from current_sp to
+ * target_sp would exceed the soft limit of the target. Expects the lock to
+ * be held. It is released while the callback runs, so callers must resolve
+ * their profiles again afterwards. */
+static void ask_soft_limit(
+        struct avolt_ctx* ctx,
+        struct sound_profile const* current_sp,
+        struct sound_profile const* target_sp,
+        long int new_vol,
+        bool relative_inc,
+        struct soft_limit_answer* answer)
+{
+    answer->target = NULL;
+    enum Volume_type vol_type;
+    long int const vol = resolve_output_volume(ctx, current_sp, target_sp,
+            new_vol, &vol_type);
+    if (!exceeds_soft_limit(target_sp, vol, vol_type, relative_inc)) return;
+
+    answer->target = target_sp;
+    answer->vol = vol;
+    answer->policy = ctx->config.soft_limit_policy;
+    if (!ctx->confirm_cb) return;
+
+    avolt_confirm_cb cb = ctx->confirm_cb;
+    void* data = ctx->confirm_data;
+    unlock_and_dispatch(ctx);
+    answer->policy = cb(ctx, target_sp, vol, data);
+    pthread_mutex_lock(&ctx->lock);
+}
+
+
+/* Switches the output from current_sp, NULL if no output is on, to
+ * target_sp and changes the volume, see resolve_output_volume for new_vol.
+ * A volume over the soft limit of the target is handled with the answer if
+ * it was given for the same target and volume, else with the soft limit
+ * policy of the configuration. Elements without a playback switch are left
+ * as they are. */
+static bool switch_output(
+        struct avolt_ctx* ctx,
+        struct sound_profile* current_sp,
+        struct sound_profile* target_sp,
+        long int new_vol,
+        bool relative_inc,
+        bool set_default_vol,
+        bool toggle_vol,
+        struct soft_limit_answer const* answer)
+{
+    enum Volume_type vol_type;
+    new_vol = resolve_output_volume(ctx, current_sp, target_sp, new_vol, &vol_type);
+
+    snd_mixer_elem_t* const current_elem = current_sp ?
+        current_sp->volume_cntrl_mixer_element : NULL;
+    long int current_vol = -1;
+    get_vol(current_elem ? current_elem : target_sp->volume_cntrl_mixer_element,
+            vol_type, &current_vol);
+
+    /* Check volume limit if setting new volume */
+    if (exceeds_soft_limit(target_sp, new_vol, vol_type, relative_inc)) {
+        enum Soft_limit_policy policy = ctx->config.soft_limit_policy;
+        if (answer->target == target_sp && answer->vol == new_vol)
+            policy = answer->policy;
+        if (policy == soft_limit_clamp) {
+            new_vol = target_sp->soft_limit_volume;
+            vol_type = target_sp->volume_type;
+            relative_inc = false;
+        }
+        else if (policy == soft_limit_reject) {
+            new_vol = target_sp->default_volume;
+            vol_type = target_sp->volume_type;
+            relative_inc = false;
+        }
+    }
+
+    /* If changing the volume set it to zero before switching element to
+     * avoid volume spikes */
+    bool const shared = current_elem == target_sp->volume_cntrl_mixer_element;
+    bool zeroed = false;
+    if (shared && new_vol != current_vol) {
+        PD_M("PRE setting volume to zero during output element switch.\n");
+        AVOLT_PROBE_PHASE("prezero");
+        snd_mixer_elem_t* const vc_elem = target_sp->volume_cntrl_mixer_element;
+        long hw_min = 0, hw_max = 0;
+        snd_mixer_selem_get_playback_volume_range(vc_elem, &hw_min, &hw_max);
+        /* Nothing is written, nor confirmed, if already at the minimum */
+        bool const at_min = is_playback_volume(vc_elem, hw_min);
+        /* Hardware percentage 0 is the minimum in every volume type */
+        if (!at_min && !set_new_volume(target_sp, 0, false, false, false,
+                    ctx->sem, hardware_percentage))
+            return false;
+
+        // Wait for the zeroed volume to be in effect to avoid volume spikes
+        AVOLT_PROBE_PHASE("settle");
+        if (!at_min)
+            settle_after_write(ctx->handle, vc_elem, hw_min, on_elem_event,
+                    ctx->config.settle_timeout_min_ms,
+                    ctx->config.settle_timeout_max_ms);
+
+        // If new_vol is relative we need to calculate new new_vol value
+        if (new_vol < 0 || relative_inc) {
+            new_vol += current_vol;
+        }
+        zeroed = true;
+    }
+
+    /* Turn on/off the outputs */
+    AVOLT_PROBE_PHASE("switch");
+    int err = 0;
+    /* Check if target_sp has a dependency with current_sp */
+    if (current_sp && current_sp->mixer_element != target_sp->volume_cntrl_mixer_element &&
+            snd_mixer_selem_has_playback_switch(current_sp->mixer_element)) {
+        /* If not switch current_sp off */
+        PD_M("switching off element: %s\n", current_sp->mixer_element_name);
+        err = set_switch(current_sp->mixer_element, false);
+        if (err) fprintf(stderr, "avolt ERROR: toggling off mixer element '%s' failed.\n", current_sp->mixer_element_name);
+    }
+
+    /* Switch target's mixer element on */
+    if (!err && snd_mixer_selem_has_playback_switch(target_sp->mixer_element)) {
+        err = set_switch(target_sp->mixer_element, true);
+        if (err) fprintf(stderr, "avolt ERROR: toggling on mixer element '%s' failed.\n", target_sp->mixer_element_name);
+    }
+    if (err) return false;
+
+    /* Nothing else to do if the volume is already right */
+    if (!zeroed && current_vol == new_vol && shared)
+        return true;
+
+    AVOLT_PROBE_PHASE("restore_volume");
+    return set_new_volume(target_sp, new_vol, relative_inc, set_default_vol,
+            toggle_vol, ctx->sem, vol_type);
+}
+
+
+/* Toggles the output to the next profile of the toggle profiles and changes
+ * its volume, see switch_output. */
+bool avolt_toggle_output(
+        struct avolt_ctx* ctx,
+        long int new_vol,
+        bool relative_inc,
+        bool set_default_vol,
+        bool toggle_vol)
+{
+    pthread_mutex_lock(&ctx->lock);
+    struct sound_profile* current_sp = get_current_sound_profile(&ctx->config);
+    struct sound_profile* target_sp = get_target_sound_profile(&ctx->config, current_sp);
+    struct soft_limit_answer answer = { .target = NULL };
+    if (target_sp)
+        ask_soft_limit(ctx, current_sp, target_sp, new_vol, relative_inc,
+                &answer);
+    if (answer.target) {
+        current_sp = get_current_sound_profile(&ctx->config);
+        target_sp = get_target_sound_profile(&ctx->config, current_sp);
+    }
+
+    bool ret = false;
+    if (!target_sp) {
+        fprintf(stderr, "avolt ERROR: No initialized profile to toggle the output to.\n");
+    }
+    else {
+        PD_M("Toggling the output to: %s\n", target_sp->profile_name);
+        ret = switch_output(ctx, current_sp, target_sp, new_vol,
+                relative_inc, set_default_vol, toggle_vol, &answer);
+    }
+    if (ret) run_post_change_hooks(ctx, "profile");
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Switches the output to the named profile and changes its volume, see
+ * switch_output. If the profile is already in use only the volume is
+ * changed. */
+bool avolt_set_profile(
+        struct avolt_ctx* ctx,
+        char const* profile_name,
+        long int new_vol,
+        bool relative_inc,
+        bool set_default_vol,
+        bool toggle_vol)
+{
+    pthread_mutex_lock(&ctx->lock);
+    bool ret = false;
+    struct sound_profile* current_sp = get_current_sound_profile(&ctx->config);
+    struct sound_profile* target_sp = get_sound_profile_by_name(&ctx->config, profile_name);
+
+    /* The output may be switched to the target while asking */
+    struct soft_limit_answer answer = { .target = NULL };
+    if (target_sp && target_sp != current_sp) {
+        ask_soft_limit(ctx, current_sp, target_sp, new_vol, relative_inc,
+                &answer);
+        if (answer.target)
+            current_sp = get_current_sound_profile(&ctx->config);
+    }
+
+    if (!target_sp) {
+        fprintf(stderr, "avolt ERROR: No initialized profile named '%s'.\n", profile_name);
+    }
+    else if (target_sp != current_sp) {
+        ret = switch_output(ctx, current_sp, target_sp, new_vol,
+                relative_inc, set_default_vol, toggle_vol, &answer);
+        if (ret) run_post_change_hooks(ctx, "profile");
+    }
+    else if (new_vol != INT_MAX || set_default_vol || toggle_vol) {
+        ret = set_new_volume(current_sp, new_vol, relative_inc,
+                set_default_vol, toggle_vol, ctx->sem,
+                ctx->config.volume_type);
+        if (ret) run_post_change_hooks(ctx, "volume");
+    }
+    else {
+        ret = true;
+    }
+
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Gets the profile currently in use, NULL if no profile is in use. The
+ * profile is owned by the context and valid until avolt_close. */
+struct sound_profile const* avolt_get_profile(struct avolt_ctx* ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    struct sound_profile const* sp = get_current_sound_profile(&ctx->config);
+    unlock_and_dispatch(ctx);
+    return sp;
+}
+
+
+/* Gets number of configured profiles, including the ones which failed to
+ * initialize (see init_ok). */
+int avolt_get_profile_count(struct avolt_ctx* ctx)
+{
+    return ctx->config.profiles_size;
+}
+
+
+/* Gets configured profile by index, NULL if index is out of range. The
+ * profile is owned by the context and valid until avolt_close. */
+struct sound_profile const* avolt_get_profile_at(
+        struct avolt_ctx* ctx,
+        int index)
+{
+    if (index < 0 || index >= ctx->config.profiles_size) return NULL;
+    return &ctx->config.profiles[index];
+}
+
+
+/* Gets the configuration of the context. It is not changed after opening. */
+struct avolt_config const* avolt_get_config(struct avolt_ctx* ctx)
+{
+    return &ctx->config;
+}
+
+
+/* Gets capture profile by name, or the default capture profile if name is
+ * NULL. Returns NULL if there is no such initialized capture profile. The
+ * profile is owned by the context and valid until avolt_close. */
+struct capture_profile const* avolt_get_capture_profile(
+        struct avolt_ctx* ctx,
+        char const* name)
+{
+    return get_capture_profile_by_name(&ctx->config, name);
+}
+
+
+/* Gets capture gain of the named capture profile, see
+ * avolt_get_capture_profile. */
+bool avolt_get_capture_gain(
+        struct avolt_ctx* ctx,
+        char const* name,
+        long int* gain)
+{
+    struct capture_profile const* cp = get_capture_profile_by_name(&ctx->config, name);
+    if (!cp) return false;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool ret = get_capture_gain(cp, gain);
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Sets capture gain of the named capture profile in alsa percentage. */
+bool avolt_set_capture_gain(
+        struct avolt_ctx* ctx,
+        char const* name,
+        long int gain)
+{
+    struct capture_profile const* cp = get_capture_profile_by_name(&ctx->config, name);
+    if (!cp) return false;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool ret = set_capture_gain(cp, gain);
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Gets whether the microphone of the named capture profile is open. */
+bool avolt_get_capture_active(
+        struct avolt_ctx* ctx,
+        char const* name,
+        bool* active)
+{
+    struct capture_profile const* cp = get_capture_profile_by_name(&ctx->config, name);
+    if (!cp) return false;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool ret = get_capture_active(cp, active);
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Opens or closes the microphone of the named capture profile with its
+ * push-to-talk mode. Capture changes don't take the volume semaphore to
+ * keep the latency low. */
+bool avolt_set_capture_active(
+        struct avolt_ctx* ctx,
+        char const* name,
+        bool active)
+{
+    struct capture_profile const* cp = get_capture_profile_by_name(&ctx->config, name);
+    if (!cp) return false;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool ret = set_capture_active(cp, active);
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Gets the number of value change events handled so far for the element
+ * push-to-talk of the named capture profile changes: the capture switch
+ * element, or the gain element in gain mode. See avolt_get_capture_profile
+ * for name. */
+bool avolt_get_capture_events(
+        struct avolt_ctx* ctx,
+        char const* name,
+        unsigned long* events)
+{
+    struct capture_profile const* cp = get_capture_profile_by_name(&ctx->config, name);
+    if (!cp) return false;
+
+    pthread_mutex_lock(&ctx->lock);
+    *events = ctx->capture_events[cp - ctx->config.capture_profiles];
+    unlock_and_dispatch(ctx);
+    return true;
+}
+
+
+/* Saves volumes and switches of the profile elements, and the active
+ * profile, to a snapshot with the given name (see get_snapshot_path). */
+bool avolt_save_snapshot(struct avolt_ctx* ctx, char const* name)
+{
+    char path[PATH_MAX];
+    if (!get_snapshot_path(name, path, sizeof(path))) {
+        fprintf(stderr, "avolt ERROR: No path for snapshot '%s'.\n", name);
+        return false;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    bool ret = save_snapshot(&ctx->config,
+            get_current_sound_profile(&ctx->config), path);
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Restores snapshot with the given name, writing only values which differ
+ * from the live values. Number of writes done is set to writes. */
+bool avolt_restore_snapshot(
+        struct avolt_ctx* ctx,
+        char const* name,
+        int* writes)
+{
+    char path[PATH_MAX];
+    *writes = 0;
+    if (!get_snapshot_path(name, path, sizeof(path))) {
+        fprintf(stderr, "avolt ERROR: No path for snapshot '%s'.\n", name);
+        return false;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    bool ret = wait_semaphore(ctx->sem);
+    if (ret) {
+        char active[64];
+        ret = restore_snapshot(ctx->handle, path, writes, active, sizeof(active));
+
+        struct sound_profile const* sp = get_current_sound_profile(&ctx->config);
+        if (ret && active[0] && (!sp || strcasecmp(sp->profile_name, active) != 0))
+            fprintf(stderr, "avolt WARNING: Snapshot was saved with profile '%s' "
+                    "but profile '%s' is active after restore.\n",
+                    active, sp ? sp->profile_name : "(none)");
+        if (!post_semaphore(ctx->sem))
+            ret = false;
+    }
+    if (ret && *writes > 0) run_post_change_hooks(ctx, "snapshot");
+    unlock_and_dispatch(ctx);
+    return ret;
+}
+
+
+/* Sets callback for profile element changes, see avolt_handle_events. */
+void avolt_set_event_callback(
+        struct avolt_ctx* ctx,
+        avolt_event_cb cb,
+        void* data)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ctx->event_cb = cb;
+    ctx->event_data = data;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+
+/* Sets callback for confirming soft limit exceeding. Without a callback the
+ * soft limit policy of the configuration is used. */
+void avolt_set_confirm_callback(
+        struct avolt_ctx* ctx,
+        avolt_confirm_cb cb,
+        void* data)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ctx->confirm_cb = cb;
+    ctx->confirm_data = data;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+
+/* Gets file descriptor which becomes readable when there are mixer events,
+ * or trailing post-change hooks, to handle with avolt_handle_events. */
+int avolt_get_fd(struct avolt_ctx* ctx)
+{
+    return ctx->epoll_fd;
+}
+
+
+/* Handles pending mixer events without blocking and calls the event
+ * callback if profile elements changed. Starts due trailing hooks.
+ * Returns the number of handled events or a negative error code. */
+int avolt_handle_events(struct avolt_ctx* ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    int ret = snd_mixer_handle_events(ctx->handle);
+
+    uint64_t expirations;
+    if (ctx->hook_timer_fd >= 0 &&
+            read(ctx->hook_timer_fd, &expirations, sizeof(expirations)) > 0)
+        run_skipped_hooks(ctx, false);
+    reap_hooks(&ctx->hook_children);
+
+    unlock_and_dispatch(ctx);
+    return ret;
+}
@@ -0,0 +1,138 @@
+#ifndef LIBAVOLT_H_INCLUDED
+#define LIBAVOLT_H_INCLUDED
+/* Embeddable avolt interface.
+ *
+ * All state is owned by a context object, so long-lived processes can keep
+ * one context open and change the volume without spawning avolt. All
+ * functions taking a context are safe to call concurrently from several
+ * threads. Volumes are given and returned in the volume type of the
+ * configuration (see VOLUME_TYPE in avolt.conf). Profiles and the
+ * configuration returned by a context are owned by it and stay valid, and
+ * unchanged, until avolt_close().
+ */
+
+#include <stdbool.h>
+
+#include "avolt.conf.h"
+
+
+struct avolt_ctx;
+
+/* Called after mixer events changed a sound or capture profile element.
+ * Called without the context lock held, so the context can be used from the
+ * callback. */
+typedef void (*avolt_event_cb)(struct avolt_ctx* ctx, void* data);
+
+/* Called when a profile change would exceed the soft limit of the target
+ * profile. Returns what to do with new_vol. Called without the context lock
+ * held and before the volume semaphore is taken, so a pending answer doesn't
+ * block other threads or avolt processes. The callback should give up after
+ * soft_limit_confirm_timeout_ms of the configuration and then return its
+ * soft_limit_policy. If the outputs change while the callback runs, the
+ * answer is discarded and the soft_limit_policy is used. */
+typedef enum Soft_limit_policy (*avolt_confirm_cb)(
+        struct avolt_ctx* ctx,
+        struct sound_profile const* target,
+        long int new_vol,
+        void* data);
+
+AVOLT_API struct avolt_ctx* avolt_open(void);
+
+AVOLT_API struct avolt_ctx* avolt_open_config(struct avolt_config* config);
+
+AVOLT_API void avolt_close(struct avolt_ctx* ctx);
+
+AVOLT_API bool avolt_get_volume(struct avolt_ctx* ctx, long int* vol);
+
+AVOLT_API bool avolt_change_volume(
+        struct avolt_ctx* ctx,
+        long int new_vol,
+        bool relative_inc,
+        bool set_default_vol,
+        bool toggle_vol);
+
+AVOLT_API bool avolt_set_volume(
+        struct avolt_ctx* ctx,
+        long int new_vol,
+        bool relative_inc);
+
+AVOLT_API bool avolt_set_default_volume(struct avolt_ctx* ctx);
+
+AVOLT_API bool avolt_toggle_volume(struct avolt_ctx* ctx, long int new_vol);
+
+AVOLT_API bool avolt_toggle_output(
+        struct avolt_ctx* ctx,
+        long int new_vol,
+        bool relative_inc,
+        bool set_default_vol,
+        bool toggle_vol);
+
+AVOLT_API bool avolt_set_profile(
+        struct avolt_ctx* ctx,
+        char const* profile_name,
+        long int new_vol,
+        bool relative_inc,
+        bool set_default_vol,
+        bool toggle_vol);
+
+AVOLT_API struct sound_profile const* avolt_get_profile(struct avolt_ctx* ctx);
+
+AVOLT_API int avolt_get_profile_count(struct avolt_ctx* ctx);
+
+AVOLT_API struct sound_profile const* avolt_get_profile_at(
+        struct avolt_ctx* ctx,
+        int index);
+
+AVOLT_API struct avolt_config const* avolt_get_config(struct avolt_ctx* ctx);
+
+AVOLT_API struct capture_profile const* avolt_get_capture_profile(
+        struct avolt_ctx* ctx,
+        char const* name);
+
+AVOLT_API bool avolt_get_capture_gain(
+        struct avolt_ctx* ctx,
+        char const* name,
+        long int* gain);
+
+AVOLT_API bool avolt_set_capture_gain(
+        struct avolt_ctx* ctx,
+        char const* name,
+        long int gain);
+
+AVOLT_API bool avolt_get_capture_active(
+        struct avolt_ctx* ctx,
+        char const* name,
+        bool* active);
+
+AVOLT_API bool avolt_set_capture_active(
+        struct avolt_ctx* ctx,
+        char const* name,
+        bool active);
+
+AVOLT_API bool avolt_get_capture_events(
+        struct avolt_ctx* ctx,
+        char const* name,
+        unsigned long* events);
+
+AVOLT_API bool avolt_save_snapshot(struct avolt_ctx* ctx, char const* name);
+
+AVOLT_API bool avolt_restore_snapshot(
+        struct avolt_ctx* ctx,
+        char const* name,
+        int* writes);
+
+AVOLT_API void avolt_set_event_callback(
+        struct avolt_ctx* ctx,
+        avolt_event_cb cb,
+        void* data);
+
+AVOLT_API void avolt_set_confirm_callback(
+        struct avolt_ctx* ctx,
+        avolt_confirm_cb cb,
+        void* data);
+
+AVOLT_API int avolt_get_fd(struct avolt_ctx* ctx);
+
+AVOLT_API int avolt_handle_events(struct avolt_ctx* ctx);
+
+#endif
@@ -0,0 +1,452 @@
+/* Mixer call recording, see mixer_trace.h. */
+#define MIXER_TRACE_NO_REDIRECT
+#include <alsa/asoundlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mixer_trace.h"
+#include "wutil.h"
+
+
+#define TRACE_MAX_ELEMS 256
+
+
+#define TRACE_OP_NAME(name) #name,
+static char const* const Trace_op_to_str[] = {
+    "elem_name",
+    TRACE_OPS(TRACE_OP_NAME)
+};
+#undef TRACE_OP_NAME
+
+
+/* Gets name of the traced operation */
+char const* trace_op_name(int op)
+{
+    return op >= 0 && op < trace_op_count ? Trace_op_to_str[op] : "unknown";
+}
+
+
+#ifdef D_AVOLT_TRACE
+
+static FILE* trace_file = NULL;
+static long long trace_start_usec;
+static mixer_trace_observer trace_observer = NULL;
+static void* trace_observer_data = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Elements seen so far, index is the element id */
+static snd_mixer_elem_t* trace_elems[TRACE_MAX_ELEMS];
+static int trace_elems_size = 0;
+
+
+/* Starts recording mixer calls to a trace file at path. Command line
+ * arguments are stored to the trace, leaving out the recording option
+ * "--record <path>".
+ * Returns false if the file can't be opened. */
+bool mixer_trace_start(char const* path, int argc, char const** argv)
+{
+    struct trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(struct trace_record);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--record") == 0) {
+            ++i;
+            continue;
+        }
+        size_t const len = strlen(argv[i]) + 1;
+        if (header.args_size + len > TRACE_ARGS_SIZE) {
+            fprintf(stderr, "avolt ERROR: Too long command line to record.\n");
+            return false;
+        }
+        memcpy(header.args + header.args_size, argv[i], len);
+        header.args_size += len;
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (!f || fwrite(&header, sizeof(header), 1, f) != 1) {
+        fprintf(stderr, "avolt ERROR: Could not open trace file '%s'.\n", path);
+        if (f) fclose(f);
+        return false;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    trace_elems_size = 0;
+    trace_start_usec = monotonic_usec();
+    trace_file = f;
+    pthread_mutex_unlock(&trace_lock);
+    atexit(mixer_trace_stop);
+    return true;
+}
+
+
+/* Stops recording and closes the trace file. */
+void mixer_trace_stop(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_file) {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+
+/* Sets function to be called after each traced call, also when not
+ * recording to a file. NULL removes the observer. */
+bool mixer_trace_set_observer(mixer_trace_observer observer, void* data)
+{
+    pthread_mutex_lock(&trace_lock);
+    trace_observer = observer;
+    trace_observer_data = data;
+    pthread_mutex_unlock(&trace_lock);
+    return true;
+}
+
+
+/* Checks whether calls need to be recorded. The state is changed from
+ * other threads, so it is read under the lock. */
+static bool tracing(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    bool const ret = trace_file || trace_observer;
+    pthread_mutex_unlock(&trace_lock);
+    return ret;
+}
+
+
+/* Gets id of the element, new elements get their name recorded.
+ * Expects trace_lock to be held. */
+static uint16_t get_elem_id(snd_mixer_elem_t* elem)
+{
+    if (!elem) return TRACE_NO_ELEM;
+    for (int i = 0; i < trace_elems_size; ++i) {
+        if (trace_elems[i] == elem) return i;
+    }
+    if (trace_elems_size == TRACE_MAX_ELEMS) return TRACE_NO_ELEM;
+
+    struct trace_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.op = trace_elem_name;
+    rec.elem = trace_elems_size;
+    rec.channel = -1;
+    strncpy(rec.u.name, snd_mixer_selem_get_name(elem), TRACE_NAME_SIZE - 1);
+    if (trace_file) fwrite(&rec, sizeof(rec), 1, trace_file);
+
+    trace_elems[trace_elems_size] = elem;
+    return trace_elems_size++;
+}
+
+
+/* Appends a call record to the trace */
+static void record_call(
+        enum trace_op op,
+        snd_mixer_elem_t* elem,
+        int channel,
+        int ret,
+        long long start_ns,
+        int64_t in0,
+        int64_t in1,
+        int64_t out0,
+        int64_t out1)
+{
+    long long const end_ns = monotonic_nsec();
+    pthread_mutex_lock(&trace_lock);
+    if (!trace_file && !trace_observer) {
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+
+    struct trace_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.op = op;
+    rec.elem = get_elem_id(elem);
+    rec.channel = channel;
+    rec.ret = ret;
+    rec.time_ns = start_ns - trace_start_usec * 1000LL;
+    rec.duration_ns = end_ns - start_ns;
+    rec.u.call.in[0] = in0;
+    rec.u.call.in[1] = in1;
+    rec.u.call.out[0] = out0;
+    rec.u.call.out[1] = out1;
+    if (trace_file) fwrite(&rec, sizeof(rec), 1, trace_file);
+
+    mixer_trace_observer const observer = trace_observer;
+    void* const data = trace_observer_data;
+    pthread_mutex_unlock(&trace_lock);
+    if (observer) observer(&rec, elem, start_ns, data);
+}
+
+
+/* Wrapper generators for the common element function signatures. Values
+ * returned through pointers are recorded only if the call succeeded. */
+
+#define TRACE_ELEM_FN(name) \
+int trace_##name(snd_mixer_elem_t* elem) \
+{ \
+    if (!tracing()) return name(elem); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem); \
+    record_call(trace_op_##name, elem, -1, ret, start, 0, 0, 0, 0); \
+    return ret; \
+}
+
+#define TRACE_CHANNEL_FN(name) \
+int trace_##name(snd_mixer_elem_t* elem, snd_mixer_selem_channel_id_t channel) \
+{ \
+    if (!tracing()) return name(elem, channel); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, channel); \
+    record_call(trace_op_##name, elem, channel, ret, start, 0, 0, 0, 0); \
+    return ret; \
+}
+
+#define TRACE_GET_FN(name, type) \
+int trace_##name(snd_mixer_elem_t* elem, snd_mixer_selem_channel_id_t channel, type* value) \
+{ \
+    if (!tracing()) return name(elem, channel, value); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, channel, value); \
+    record_call(trace_op_##name, elem, channel, ret, start, 0, 0, \
+            ret == 0 ? *value : 0, 0); \
+    return ret; \
+}
+
+#define TRACE_SET_FN(name, type) \
+int trace_##name(snd_mixer_elem_t* elem, snd_mixer_selem_channel_id_t channel, type value) \
+{ \
+    if (!tracing()) return name(elem, channel, value); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, channel, value); \
+    record_call(trace_op_##name, elem, channel, ret, start, value, 0, 0, 0); \
+    return ret; \
+}
+
+#define TRACE_SET_DIR_FN(name) \
+int trace_##name(snd_mixer_elem_t* elem, snd_mixer_selem_channel_id_t channel, long value, int dir) \
+{ \
+    if (!tracing()) return name(elem, channel, value, dir); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, channel, value, dir); \
+    record_call(trace_op_##name, elem, channel, ret, start, value, dir, 0, 0); \
+    return ret; \
+}
+
+#define TRACE_SET_ALL_FN(name, type) \
+int trace_##name(snd_mixer_elem_t* elem, type value) \
+{ \
+    if (!tracing()) return name(elem, value); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, value); \
+    record_call(trace_op_##name, elem, -1, ret, start, value, 0, 0, 0); \
+    return ret; \
+}
+
+#define TRACE_SET_ALL_DIR_FN(name) \
+int trace_##name(snd_mixer_elem_t* elem, long value, int dir) \
+{ \
+    if (!tracing()) return name(elem, value, dir); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, value, dir); \
+    record_call(trace_op_##name, elem, -1, ret, start, value, dir, 0, 0); \
+    return ret; \
+}
+
+#define TRACE_RANGE_FN(name) \
+int trace_##name(snd_mixer_elem_t* elem, long* min, long* max) \
+{ \
+    if (!tracing()) return name(elem, min, max); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, min, max); \
+    record_call(trace_op_##name, elem, -1, ret, start, 0, 0, \
+            ret == 0 ? *min : 0, ret == 0 ? *max : 0); \
+    return ret; \
+}
+
+#define TRACE_ASK_FN(name) \
+int trace_##name(snd_mixer_elem_t* elem, long dBvalue, int dir, long* value) \
+{ \
+    if (!tracing()) return name(elem, dBvalue, dir, value); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, dBvalue, dir, value); \
+    record_call(trace_op_##name, elem, -1, ret, start, dBvalue, dir, \
+            ret == 0 ? *value : 0, 0); \
+    return ret; \
+}
+
+#define TRACE_ASK_DB_FN(name) \
+int trace_##name(snd_mixer_elem_t* elem, long value, long* dBvalue) \
+{ \
+    if (!tracing()) return name(elem, value, dBvalue); \
+    long long const start = monotonic_nsec(); \
+    int const ret = name(elem, value, dBvalue); \
+    record_call(trace_op_##name, elem, -1, ret, start, value, 0, \
+            ret == 0 ? *dBvalue : 0, 0); \
+    return ret; \
+}
+
+
+TRACE_ELEM_FN(snd_mixer_selem_has_playback_switch)
+TRACE_ELEM_FN(snd_mixer_selem_has_playback_volume)
+TRACE_CHANNEL_FN(snd_mixer_selem_has_playback_channel)
+TRACE_GET_FN(snd_mixer_selem_get_playback_volume, long)
+TRACE_GET_FN(snd_mixer_selem_get_playback_dB, long)
+TRACE_GET_FN(snd_mixer_selem_get_playback_switch, int)
+TRACE_SET_FN(snd_mixer_selem_set_playback_volume, long)
+TRACE_SET_DIR_FN(snd_mixer_selem_set_playback_dB)
+TRACE_SET_FN(snd_mixer_selem_set_playback_switch, int)
+TRACE_SET_ALL_FN(snd_mixer_selem_set_playback_volume_all, long)
+TRACE_SET_ALL_DIR_FN(snd_mixer_selem_set_playback_dB_all)
+TRACE_SET_ALL_FN(snd_mixer_selem_set_playback_switch_all, int)
+TRACE_RANGE_FN(snd_mixer_selem_get_playback_volume_range)
+TRACE_RANGE_FN(snd_mixer_selem_get_playback_dB_range)
+TRACE_ASK_FN(snd_mixer_selem_ask_playback_dB_vol)
+TRACE_ASK_DB_FN(snd_mixer_selem_ask_playback_vol_dB)
+
+TRACE_ELEM_FN(snd_mixer_selem_has_capture_switch)
+TRACE_ELEM_FN(snd_mixer_selem_has_capture_volume)
+TRACE_CHANNEL_FN(snd_mixer_selem_has_capture_channel)
+TRACE_GET_FN(snd_mixer_selem_get_capture_volume, long)
+TRACE_GET_FN(snd_mixer_selem_get_capture_dB, long)
+TRACE_GET_FN(snd_mixer_selem_get_capture_switch, int)
+TRACE_SET_FN(snd_mixer_selem_set_capture_volume, long)
+TRACE_SET_DIR_FN(snd_mixer_selem_set_capture_dB)
+TRACE_SET_FN(snd_mixer_selem_set_capture_switch, int)
+TRACE_SET_ALL_FN(snd_mixer_selem_set_capture_volume_all, long)
+TRACE_SET_ALL_FN(snd_mixer_selem_set_capture_switch_all, int)
+TRACE_RANGE_FN(snd_mixer_selem_get_capture_volume_range)
+TRACE_RANGE_FN(snd_mixer_selem_get_capture_dB_range)
+TRACE_ASK_FN(snd_mixer_selem_ask_capture_dB_vol)
+TRACE_ASK_DB_FN(snd_mixer_selem_ask_capture_vol_dB)
+
+
+/* Mixer level functions */
+
+int trace_snd_mixer_open(snd_mixer_t** mixer, int mode)
+{
+    if (!tracing()) return snd_mixer_open(mixer, mode);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_open(mixer, mode);
+    record_call(trace_op_snd_mixer_open, NULL, -1, ret, start, mode, 0, 0, 0);
+    return ret;
+}
+
+int trace_snd_mixer_close(snd_mixer_t* mixer)
+{
+    if (!tracing()) return snd_mixer_close(mixer);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_close(mixer);
+    record_call(trace_op_snd_mixer_close, NULL, -1, ret, start, 0, 0, 0, 0);
+    return ret;
+}
+
+int trace_snd_mixer_attach(snd_mixer_t* mixer, char const* name)
+{
+    if (!tracing()) return snd_mixer_attach(mixer, name);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_attach(mixer, name);
+    record_call(trace_op_snd_mixer_attach, NULL, -1, ret, start, 0, 0, 0, 0);
+    return ret;
+}
+
+int trace_snd_mixer_selem_register(snd_mixer_t* mixer,
+        struct snd_mixer_selem_regopt* options, snd_mixer_class_t** classp)
+{
+    if (!tracing()) return snd_mixer_selem_register(mixer, options, classp);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_selem_register(mixer, options, classp);
+    record_call(trace_op_snd_mixer_selem_register, NULL, -1, ret, start, 0, 0, 0, 0);
+    return ret;
+}
+
+int trace_snd_mixer_load(snd_mixer_t* mixer)
+{
+    if (!tracing()) return snd_mixer_load(mixer);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_load(mixer);
+    record_call(trace_op_snd_mixer_load, NULL, -1, ret, start, 0, 0, 0, 0);
+    return ret;
+}
+
+snd_mixer_elem_t* trace_snd_mixer_first_elem(snd_mixer_t* mixer)
+{
+    if (!tracing()) return snd_mixer_first_elem(mixer);
+    long long const start = monotonic_nsec();
+    snd_mixer_elem_t* const elem = snd_mixer_first_elem(mixer);
+    record_call(trace_op_snd_mixer_first_elem, elem, -1, elem != NULL, start, 0, 0, 0, 0);
+    return elem;
+}
+
+snd_mixer_elem_t* trace_snd_mixer_elem_next(snd_mixer_elem_t* elem)
+{
+    if (!tracing()) return snd_mixer_elem_next(elem);
+    long long const start = monotonic_nsec();
+    snd_mixer_elem_t* const next = snd_mixer_elem_next(elem);
+    record_call(trace_op_snd_mixer_elem_next, next, -1, next != NULL, start, 0, 0, 0, 0);
+    return next;
+}
+
+int trace_snd_mixer_handle_events(snd_mixer_t* mixer)
+{
+    if (!tracing()) return snd_mixer_handle_events(mixer);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_handle_events(mixer);
+    record_call(trace_op_snd_mixer_handle_events, NULL, -1, ret, start, 0, 0, 0, 0);
+    return ret;
+}
+
+int trace_snd_mixer_poll_descriptors_count(snd_mixer_t* mixer)
+{
+    if (!tracing()) return snd_mixer_poll_descriptors_count(mixer);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_poll_descriptors_count(mixer);
+    record_call(trace_op_snd_mixer_poll_descriptors_count, NULL, -1, ret, start, 0, 0, 0, 0);
+    return ret;
+}
+
+int trace_snd_mixer_poll_descriptors(snd_mixer_t* mixer,
+        struct pollfd* pfds, unsigned int space)
+{
+    if (!tracing()) return snd_mixer_poll_descriptors(mixer, pfds, space);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_poll_descriptors(mixer, pfds, space);
+    record_call(trace_op_snd_mixer_poll_descriptors, NULL, -1, ret, start, space, 0, 0, 0);
+    return ret;
+}
+
+int trace_snd_mixer_poll_descriptors_revents(snd_mixer_t* mixer,
+        struct pollfd* pfds, unsigned int nfds, unsigned short* revents)
+{
+    if (!tracing()) return snd_mixer_poll_descriptors_revents(mixer, pfds, nfds, revents);
+    long long const start = monotonic_nsec();
+    int const ret = snd_mixer_poll_descriptors_revents(mixer, pfds, nfds, revents);
+    record_call(trace_op_snd_mixer_poll_descriptors_revents, NULL, -1, ret, start,
+            nfds, 0, ret == 0 ? *revents : 0, 0);
+    return ret;
+}
+
+#else
+
+bool mixer_trace_start(char const* path, int argc, char const** argv)
+{
+    fprintf(stderr, "avolt ERROR: Recording needs a build with D_AVOLT_TRACE.\n");
+    return false;
+}
+
+
+void mixer_trace_stop(void)
+{
+}
+
+
+bool mixer_trace_set_observer(mixer_trace_observer observer, void* data)
+{
+    return observer == NULL;
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef MIXER_TRACE_H_INCLUDED
+#define MIXER_TRACE_H_INCLUDED
+/* Recording of mixer calls to a binary trace file.
+ *
+ * Including this header after <alsa/asoundlib.h> redirects the traced
+ * snd_mixer_* functions (TRACE_OPS) to wrappers which pass the call through
+ * and, while recording (mixer_trace_start), append a trace_record with the
+ * arguments, results, return value, start time and duration of the call.
+ * Pure accessors like snd_mixer_selem_get_name are not traced, element
+ * names are recorded once per element with trace_elem_name records.
+ *
+ * The wrappers are compiled in only when D_AVOLT_TRACE is defined (see
+ * `make help`, `make tools` always has them). Otherwise nothing is
+ * redirected and mixer_trace_start and mixer_trace_set_observer fail.
+ *
+ * Define MIXER_TRACE_NO_REDIRECT before including to get only the format
+ * definitions (for the wrappers themselves and tools reading traces).
+ */
+
+#include <alsa/asoundlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define TRACE_MAGIC "AVTR"
+#define TRACE_VERSION 2
+#define TRACE_NAME_SIZE 32
+#define TRACE_ARGS_SIZE 256
+#define TRACE_NO_ELEM 0xffff
+
+
+#define TRACE_OPS(X) \
+    X(snd_mixer_open) \
+    X(snd_mixer_close) \
+    X(snd_mixer_attach) \
+    X(snd_mixer_selem_register) \
+    X(snd_mixer_load) \
+    X(snd_mixer_first_elem) \
+    X(snd_mixer_elem_next) \
+    X(snd_mixer_handle_events) \
+    X(snd_mixer_poll_descriptors_count) \
+    X(snd_mixer_poll_descriptors) \
+    X(snd_mixer_poll_descriptors_revents) \
+    X(snd_mixer_selem_has_playback_switch) \
+    X(snd_mixer_selem_has_playback_volume) \
+    X(snd_mixer_selem_has_playback_channel) \
+    X(snd_mixer_selem_get_playback_volume) \
+    X(snd_mixer_selem_get_playback_dB) \
+    X(snd_mixer_selem_get_playback_switch) \
+    X(snd_mixer_selem_set_playback_volume) \
+    X(snd_mixer_selem_set_playback_dB) \
+    X(snd_mixer_selem_set_playback_switch) \
+    X(snd_mixer_selem_set_playback_volume_all) \
+    X(snd_mixer_selem_set_playback_dB_all) \
+    X(snd_mixer_selem_set_playback_switch_all) \
+    X(snd_mixer_selem_get_playback_volume_range) \
+    X(snd_mixer_selem_get_playback_dB_range) \
+    X(snd_mixer_selem_ask_playback_dB_vol) \
+    X(snd_mixer_selem_ask_playback_vol_dB) \
+    X(snd_mixer_selem_has_capture_switch) \
+    X(snd_mixer_selem_has_capture_volume) \
+    X(snd_mixer_selem_has_capture_channel) \
+    X(snd_mixer_selem_get_capture_volume) \
+    X(snd_mixer_selem_get_capture_dB) \
+    X(snd_mixer_selem_get_capture_switch) \
+    X(snd_mixer_selem_set_capture_volume) \
+    X(snd_mixer_selem_set_capture_dB) \
+    X(snd_mixer_selem_set_capture_switch) \
+    X(snd_mixer_selem_set_capture_volume_all) \
+    X(snd_mixer_selem_set_capture_switch_all) \
+    X(snd_mixer_selem_get_capture_volume_range) \
+    X(snd_mixer_selem_get_capture_dB_range) \
+    X(snd_mixer_selem_ask_capture_dB_vol) \
+    X(snd_mixer_selem_ask_capture_vol_dB)
+
+#define TRACE_OP_ENUM(name) trace_op_##name,
+enum trace_op {
+    trace_elem_name,        // Not a call, gives name of element id elem.
+    TRACE_OPS(TRACE_OP_ENUM)
+    trace_op_count
+};
+#undef TRACE_OP_ENUM
+
+
+/* Trace file starts with this header */
+struct trace_header
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    /* Command line arguments of the recorded run, without the program name
+     * and the recording option. Each argument is '\0' terminated. */
+    uint32_t args_size;
+    char args[TRACE_ARGS_SIZE];
+};
+
+/* One recorded call. Values are in host byte order. */
+struct trace_record
+{
+    uint16_t op;            // enum trace_op
+    uint16_t elem;          // Element id, TRACE_NO_ELEM if none.
+    int32_t channel;        // Channel argument, -1 if none.
+    int32_t ret;            // Return value, for element getters 0/1.
+    uint32_t duration_ns;
+    uint64_t time_ns;       // Start time from the start of the recording.
+    union {
+        struct {
+            int64_t in[2];  // Value arguments, for example value and dir.
+            int64_t out[2]; // Values returned through pointers.
+        } call;
+        char name[TRACE_NAME_SIZE]; // trace_elem_name: name of elem.
+    } u;
+};
+
+
+/* Called after each traced call with the record, the element of the call
+ * (NULL if none) and the CLOCK_MONOTONIC start time of the call. */
+typedef void (*mixer_trace_observer)(
+        struct trace_record const* record,
+        snd_mixer_elem_t* elem,
+        long long start_ns,
+        void* data);
+
+bool mixer_trace_start(char const* path, int argc, char const** argv);
+
+void mixer_trace_stop(void);
+
+bool mixer_trace_set_observer(mixer_trace_observer observer, void* data);
+
+char const* trace_op_name(int op);
+
+
+#if defined(D_AVOLT_TRACE) && !defined(MIXER_TRACE_NO_REDIRECT)
+
+int trace_snd_mixer_open(snd_mixer_t** mixer, int mode);
+int trace_snd_mixer_close(snd_mixer_t* mixer);
+int trace_snd_mixer_attach(snd_mixer_t* mixer, char const* name);
+int trace_snd_mixer_selem_register(snd_mixer_t* mixer,
+        struct snd_mixer_selem_regopt* options, snd_mixer_class_t** classp);
+int trace_snd_mixer_load(snd_mixer_t* mixer);
+snd_mixer_elem_t* trace_snd_mixer_first_elem(snd_mixer_t* mixer);
+snd_mixer_elem_t* trace_snd_mixer_elem_next(snd_mixer_elem_t* elem);
+int trace_snd_mixer_handle_events(snd_mixer_t* mixer);
+int trace_snd_mixer_poll_descriptors_count(snd_mixer_t* mixer);
+int trace_snd_mixer_poll_descriptors(snd_mixer_t* mixer,
+        struct pollfd* pfds, unsigned int space);
+int trace_snd_mixer_poll_descriptors_revents(snd_mixer_t* mixer,
+        struct pollfd* pfds, unsigned int nfds, unsigned short* revents);
+
+int trace_snd_mixer_selem_has_playback_switch(snd_mixer_elem_t* elem);
+int trace_snd_mixer_selem_has_playback_volume(snd_mixer_elem_t* elem);
+int trace_snd_mixer_selem_has_playback_channel(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel);
+int trace_snd_mixer_selem_get_playback_volume(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long* value);
+int trace_snd_mixer_selem_get_playback_dB(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long* value);
+int trace_snd_mixer_selem_get_playback_switch(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, int* value);
+int trace_snd_mixer_selem_set_playback_volume(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long value);
+int trace_snd_mixer_selem_set_playback_dB(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long value, int dir);
+int trace_snd_mixer_selem_set_playback_switch(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, int value);
+int trace_snd_mixer_selem_set_playback_volume_all(snd_mixer_elem_t* elem,
+        long value);
+int trace_snd_mixer_selem_set_playback_dB_all(snd_mixer_elem_t* elem,
+        long value, int dir);
+int trace_snd_mixer_selem_set_playback_switch_all(snd_mixer_elem_t* elem,
+        int value);
+int trace_snd_mixer_selem_get_playback_volume_range(snd_mixer_elem_t* elem,
+        long* min, long* max);
+int trace_snd_mixer_selem_get_playback_dB_range(snd_mixer_elem_t* elem,
+        long* min, long* max);
+int trace_snd_mixer_selem_ask_playback_dB_vol(snd_mixer_elem_t* elem,
+        long dBvalue, int dir, long* value);
+int trace_snd_mixer_selem_ask_playback_vol_dB(snd_mixer_elem_t* elem,
+        long value, long* dBvalue);
+
+int trace_snd_mixer_selem_has_capture_switch(snd_mixer_elem_t* elem);
+int trace_snd_mixer_selem_has_capture_volume(snd_mixer_elem_t* elem);
+int trace_snd_mixer_selem_has_capture_channel(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel);
+int trace_snd_mixer_selem_get_capture_volume(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long* value);
+int trace_snd_mixer_selem_get_capture_dB(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long* value);
+int trace_snd_mixer_selem_get_capture_switch(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, int* value);
+int trace_snd_mixer_selem_set_capture_volume(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long value);
+int trace_snd_mixer_selem_set_capture_dB(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, long value, int dir);
+int trace_snd_mixer_selem_set_capture_switch(snd_mixer_elem_t* elem,
+        snd_mixer_selem_channel_id_t channel, int value);
+int trace_snd_mixer_selem_set_capture_volume_all(snd_mixer_elem_t* elem,
+        long value);
+int trace_snd_mixer_selem_set_capture_switch_all(snd_mixer_elem_t* elem,
+        int value);
+int trace_snd_mixer_selem_get_capture_volume_range(snd_mixer_elem_t* elem,
+        long* min, long* max);
+int trace_snd_mixer_selem_get_capture_dB_range(snd_mixer_elem_t* elem,
+        long* min, long* max);
+int trace_snd_mixer_selem_ask_capture_dB_vol(snd_mixer_elem_t* elem,
+        long dBvalue, int dir, long* value);
+int trace_snd_mixer_selem_ask_capture_vol_dB(snd_mixer_elem_t* elem,
+        long value, long* dBvalue);
+
+#define snd_mixer_open trace_snd_mixer_open
+#define snd_mixer_close trace_snd_mixer_close
+#define snd_mixer_attach trace_snd_mixer_attach
+#define snd_mixer_selem_register trace_snd_mixer_selem_register
+#define snd_mixer_load trace_snd_mixer_load
+#define snd_mixer_first_elem trace_snd_mixer_first_elem
+#define snd_mixer_elem_next trace_snd_mixer_elem_next
+#define snd_mixer_handle_events trace_snd_mixer_handle_events
+#define snd_mixer_poll_descriptors_count trace_snd_mixer_poll_descriptors_count
+#define snd_mixer_poll_descriptors trace_snd_mixer_poll_descriptors
+#define snd_mixer_poll_descriptors_revents trace_snd_mixer_poll_descriptors_revents
+
+#define snd_mixer_selem_has_playback_switch trace_snd_mixer_selem_has_playback_switch
+#define snd_mixer_selem_has_playback_volume trace_snd_mixer_selem_has_playback_volume
+#define snd_mixer_selem_has_playback_channel trace_snd_mixer_selem_has_playback_channel
+#define snd_mixer_selem_get_playback_volume trace_snd_mixer_selem_get_playback_volume
+#define snd_mixer_selem_get_playback_dB trace_snd_mixer_selem_get_playback_dB
+#define snd_mixer_selem_get_playback_switch trace_snd_mixer_selem_get_playback_switch
+#define snd_mixer_selem_set_playback_volume trace_snd_mixer_selem_set_playback_volume
+#define snd_mixer_selem_set_playback_dB trace_snd_mixer_selem_set_playback_dB
+#define snd_mixer_selem_set_playback_switch trace_snd_mixer_selem_set_playback_switch
+#define snd_mixer_selem_set_playback_volume_all trace_snd_mixer_selem_set_playback_volume_all
+#define snd_mixer_selem_set_playback_dB_all trace_snd_mixer_selem_set_playback_dB_all
+#define snd_mixer_selem_set_playback_switch_all trace_snd_mixer_selem_set_playback_switch_all
+#define snd_mixer_selem_get_playback_volume_range trace_snd_mixer_selem_get_playback_volume_range
+#define snd_mixer_selem_get_playback_dB_range trace_snd_mixer_selem_get_playback_dB_range
+#define snd_mixer_selem_ask_playback_dB_vol trace_snd_mixer_selem_ask_playback_dB_vol
+#define snd_mixer_selem_ask_playback_vol_dB trace_snd_mixer_selem_ask_playback_vol_dB
+
+#define snd_mixer_selem_has_capture_switch trace_snd_mixer_selem_has_capture_switch
+#define snd_mixer_selem_has_capture_volume trace_snd_mixer_selem_has_capture_volume
+#define snd_mixer_selem_has_capture_channel trace_snd_mixer_selem_has_capture_channel
+#define snd_mixer_selem_get_capture_volume trace_snd_mixer_selem_get_capture_volume
+#define snd_mixer_selem_get_capture_dB trace_snd_mixer_selem_get_capture_dB
+#define snd_mixer_selem_get_capture_switch trace_snd_mixer_selem_get_capture_switch
+#define snd_mixer_selem_set_capture_volume trace_snd_mixer_selem_set_capture_volume
+#define snd_mixer_selem_set_capture_dB trace_snd_mixer_selem_set_capture_dB
+#define snd_mixer_selem_set_capture_switch trace_snd_mixer_selem_set_capture_switch
+#define snd_mixer_selem_set_capture_volume_all trace_snd_mixer_selem_set_capture_volume_all
+#define snd_mixer_selem_set_capture_switch_all trace_snd_mixer_selem_set_capture_switch_all
+#define snd_mixer_selem_get_capture_volume_range trace_snd_mixer_selem_get_capture_volume_range
+#define snd_mixer_selem_get_capture_dB_range trace_snd_mixer_selem_get_capture_dB_range
+#define snd_mixer_selem_ask_capture_dB_vol trace_snd_mixer_selem_ask_capture_dB_vol
+#define snd_mixer_selem_ask_capture_vol_dB trace_snd_mixer_selem_ask_capture_vol_dB
+
+#endif
+
+#endif
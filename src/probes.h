@@ -0,0 +1,89 @@
+#ifndef PROBES_H_INCLUDED
+#define PROBES_H_INCLUDED
+/* USDT static tracepoints, compiled in only when D_AVOLT_USDT is defined
+ * (see `make help`). Probes are in provider "avolt":
+ *
+ *  phase(name)
+ *      Program phase named name begins.
+ *  <op>_entry(elem_name, volume_type, old, new)
+ *  <op>_return(elem_name, volume_type, old, new, rc)
+ *      Around mixer operation <op>: get_vol, set_vol, toggle_volume and
+ *      switch. For volume operations old and new are hardware volumes of
+ *      the first channel, on entry new is the requested volume in the
+ *      volume type. For switch volume_type is -1 and old and new are
+ *      playback switch states.
+ *
+ * Arguments only needed by a probe are computed under
+ * AVOLT_PROBE_ENABLED(<probe>), like avolt_<probe>_ENABLED() of dtrace -h.
+ */
+
+#ifdef D_AVOLT_USDT
+
+#include <alsa/asoundlib.h>
+/* Tracers set the semaphore of a probe while attached to it, the probe
+ * arguments are only computed then */
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+/* Weak, so every file using the probes can define the semaphores */
+#define AVOLT_PROBE_SEMAPHORE(probe) \
+    unsigned short avolt_##probe##_semaphore \
+        __attribute__((weak, section(".probes"))) = 0
+
+AVOLT_PROBE_SEMAPHORE(phase);
+AVOLT_PROBE_SEMAPHORE(get_vol_entry);
+AVOLT_PROBE_SEMAPHORE(get_vol_return);
+AVOLT_PROBE_SEMAPHORE(set_vol_entry);
+AVOLT_PROBE_SEMAPHORE(set_vol_return);
+AVOLT_PROBE_SEMAPHORE(toggle_volume_entry);
+AVOLT_PROBE_SEMAPHORE(toggle_volume_return);
+AVOLT_PROBE_SEMAPHORE(switch_entry);
+AVOLT_PROBE_SEMAPHORE(switch_return);
+
+#define AVOLT_PROBE_ENABLED(probe) \
+    __builtin_expect(avolt_##probe##_semaphore, 0)
+
+#define AVOLT_PROBE_PHASE(name) \
+    do { \
+        if (AVOLT_PROBE_ENABLED(phase)) \
+            DTRACE_PROBE1(avolt, phase, name); \
+    } while (0)
+#define AVOLT_PROBE_ENTRY(op, elem, volume_type, old, new) \
+    do { \
+        if (AVOLT_PROBE_ENABLED(op##_entry)) \
+            DTRACE_PROBE4(avolt, op##_entry, snd_mixer_selem_get_name(elem), \
+                    (int)(volume_type), (long)(old), (long)(new)); \
+    } while (0)
+#define AVOLT_PROBE_RETURN(op, elem, volume_type, old, new, rc) \
+    do { \
+        if (AVOLT_PROBE_ENABLED(op##_return)) \
+            DTRACE_PROBE5(avolt, op##_return, snd_mixer_selem_get_name(elem), \
+                    (int)(volume_type), (long)(old), (long)(new), (int)(rc)); \
+    } while (0)
+
+/* Cached hardware volume of the first channel, doesn't access the device */
+static inline long probe_hw_vol(snd_mixer_elem_t* elem)
+{
+    long vol = -1;
+    snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT, &vol);
+    return vol;
+}
+
+/* Cached playback switch of the first channel */
+static inline int probe_switch(snd_mixer_elem_t* elem)
+{
+    int sw = -1;
+    snd_mixer_selem_get_playback_switch(elem, SND_MIXER_SCHN_FRONT_LEFT, &sw);
+    return sw;
+}
+
+#else
+
+#define AVOLT_PROBE_ENABLED(probe) 0
+#define AVOLT_PROBE_PHASE(name)
+#define AVOLT_PROBE_ENTRY(op, elem, volume_type, old, new)
+#define AVOLT_PROBE_RETURN(op, elem, volume_type, old, new, rc)
+
+#endif
+
+#endif
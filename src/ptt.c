@@ -0,0 +1,218 @@
+/* Push-to-talk, see ptt.h. */
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "ptt.h"
+#include "avolt.conf.h"
+#include "wutil.h"
+
+
+#define PTT_LINE_SIZE 64
+
+
+/* Latencies of the handled commands in microseconds */
+struct ptt_stats
+{
+    int commands;
+    int unconfirmed;            // Commands without a confirming event.
+    long long write_sum;
+    long long write_max;
+    long long event_min;
+    long long event_max;
+    long long event_sum;
+};
+
+
+/* Parses a command line. Returns false for unknown commands. */
+static bool parse_command(char const* line, bool* press)
+{
+    if (strcasecmp(line, "press") == 0 || strcasecmp(line, "p") == 0 ||
+            strcmp(line, "1") == 0) {
+        *press = true;
+        return true;
+    }
+    if (strcasecmp(line, "release") == 0 || strcasecmp(line, "r") == 0 ||
+            strcmp(line, "0") == 0) {
+        *press = false;
+        return true;
+    }
+    return false;
+}
+
+
+/* Waits for a mixer event on the push-to-talk element of the profile after
+ * events_before, after which the change must be in effect. Returns the time
+ * of the event, or 0 if there was none before the settle timeout. */
+static long long wait_change_event(
+        struct avolt_ctx* ctx,
+        char const* profile_name,
+        bool press,
+        unsigned long events_before,
+        int timeout_ms)
+{
+    struct pollfd fd = { .fd = avolt_get_fd(ctx), .events = POLLIN };
+    long long const deadline = monotonic_usec() + timeout_ms * 1000LL;
+    while (true) {
+        long long const left = deadline - monotonic_usec();
+        if (left <= 0) return 0;
+        int const n = poll(&fd, 1, (left + 999) / 1000);
+        if (n < 0 && errno != EINTR) return 0;
+        if (n <= 0) continue;
+
+        long long const t = monotonic_usec();
+        avolt_handle_events(ctx);
+        unsigned long events;
+        bool active;
+        if (avolt_get_capture_events(ctx, profile_name, &events) &&
+                events != events_before &&
+                avolt_get_capture_active(ctx, profile_name, &active) && active == press)
+            return t;
+    }
+}
+
+
+/* Applies one command and records its latencies */
+static bool apply_command(
+        struct avolt_ctx* ctx,
+        char const* profile_name,
+        bool press,
+        long long t0,
+        struct ptt_stats* stats)
+{
+    /* Events of earlier changes must not confirm this one */
+    avolt_handle_events(ctx);
+
+    /* Unchanged values make no change event to wait for */
+    bool active;
+    unsigned long events = 0;
+    avolt_get_capture_events(ctx, profile_name, &events);
+    if (avolt_get_capture_active(ctx, profile_name, &active) && active == press) {
+        printf("%s: already %s\n", press ? "press" : "release",
+                press ? "open" : "closed");
+        return true;
+    }
+
+    bool const ok = avolt_set_capture_active(ctx, profile_name, press);
+    long long const t1 = monotonic_usec();
+    if (!ok) {
+        printf("%s: failed\n", press ? "press" : "release");
+        return false;
+    }
+    long long const t2 = wait_change_event(ctx, profile_name, press, events,
+            avolt_get_config(ctx)->settle_timeout_max_ms);
+
+    long long const write_us = t1 - t0;
+    stats->commands++;
+    stats->write_sum += write_us;
+    if (write_us > stats->write_max) stats->write_max = write_us;
+    if (!t2) {
+        stats->unconfirmed++;
+        printf("%s: write %lli us, no change event\n",
+                press ? "press" : "release", write_us);
+        return true;
+    }
+
+    long long const event_us = t2 - t0;
+    int const confirmed = stats->commands - stats->unconfirmed;
+    if (confirmed == 1 || event_us < stats->event_min) stats->event_min = event_us;
+    if (event_us > stats->event_max) stats->event_max = event_us;
+    stats->event_sum += event_us;
+    printf("%s: write %lli us, applied %lli us\n",
+                press ? "press" : "release", write_us, event_us);
+    return true;
+}
+
+
+/* Reads push-to-talk commands from stdin until end of input.
+ * Returns false if the capture profile could not be found or changes
+ * failed. */
+bool run_push_to_talk(struct avolt_ctx* ctx, char const* profile_name, bool verbose)
+{
+    struct capture_profile const* cp = avolt_get_capture_profile(ctx, profile_name);
+    if (!cp) {
+        fprintf(stderr, "avolt ERROR: No capture profile '%s' available.\n",
+                profile_name ? profile_name : "(default)");
+        return false;
+    }
+    profile_name = cp->profile_name;
+    if (verbose)
+        printf("Push-to-talk on '%s', %s\n", cp->mixer_element_name,
+                cp->ptt_mode == ptt_switch ? "capture switch" : "gain");
+    fflush(stdout);
+
+    struct ptt_stats stats = { 0 };
+    bool ret = true;
+    char line[PTT_LINE_SIZE];
+    size_t line_size = 0;
+    bool overlong = false;
+
+    /* Mixer events are handled while waiting so they don't pile up */
+    struct pollfd fds[2] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = avolt_get_fd(ctx), .events = POLLIN },
+    };
+
+    while (true) {
+        int const n = poll(fds, 2, -1);
+        if (n < 0 && errno != EINTR) {
+            ret = false;
+            break;
+        }
+        if (n <= 0) continue;
+        if (fds[1].revents) avolt_handle_events(ctx);
+        if (!fds[0].revents) continue;
+
+        char buf[256];
+        ssize_t const size = read(STDIN_FILENO, buf, sizeof(buf));
+        /* Commands are timed from their arrival, so those read together
+         * include the time spent on the ones before them */
+        long long const t0 = monotonic_usec();
+        if (size < 0 && errno == EINTR) continue;
+        if (size <= 0) {
+            ret = ret && size == 0;
+            break;
+        }
+        for (ssize_t i = 0; i < size; ++i) {
+            if (buf[i] != '\n') {
+                /* Overlong lines are rejected as a whole */
+                if (line_size < PTT_LINE_SIZE - 1)
+                    line[line_size++] = buf[i];
+                else
+                    overlong = true;
+                continue;
+            }
+            if (line_size > 0 && line[line_size - 1] == '\r') --line_size;
+            line[line_size] = '\0';
+
+            bool press;
+            if (overlong || !parse_command(line, &press)) {
+                if (line_size > 0)
+                    fprintf(stderr, "avolt: Ignoring unknown command '%s'.\n", line);
+            }
+            else if (!apply_command(ctx, profile_name, press, t0, &stats)) {
+                ret = false;
+            }
+            fflush(stdout);
+            line_size = 0;
+            overlong = false;
+        }
+    }
+
+    int const confirmed = stats.commands - stats.unconfirmed;
+    if (stats.commands > 0)
+        printf("%i commands: write avg %lli max %lli us", stats.commands,
+                stats.write_sum / stats.commands, stats.write_max);
+    if (confirmed > 0)
+        printf(", applied min %lli avg %lli max %lli us", stats.event_min,
+                stats.event_sum / confirmed, stats.event_max);
+    if (stats.unconfirmed > 0)
+        printf(", %i without change event", stats.unconfirmed);
+    if (stats.commands > 0)
+        printf("\n");
+    return ret;
+}
@@ -0,0 +1,20 @@
+#ifndef PTT_H_INCLUDED
+#define PTT_H_INCLUDED
+/* Push-to-talk on a capture profile.
+ *
+ * Commands are read from stdin one per line: "press" (or "p", "1") opens the
+ * microphone and "release" (or "r", "0") closes it, by the capture switch or
+ * gain as set in the push-to-talk mode of the profile. The mixer stays open
+ * between commands. For each command the latency from reading the command
+ * to the write returning and to the mixer event of the change is reported,
+ * and a summary is printed at the end of input.
+ */
+
+#include <stdbool.h>
+
+#include "libavolt.h"
+
+
+bool run_push_to_talk(struct avolt_ctx* ctx, char const* profile_name, bool verbose);
+
+#endif
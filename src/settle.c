@@ -0,0 +1,273 @@
+/* Waiting for the mixer to confirm written values before continuing.
+ *
+ * Values written through the simple mixer interface are cached by alsa-lib
+ * right away, but the hardware (and the driver) might apply them later. The
+ * driver confirms the write by sending a value change event, after which the
+ * re-read element value reflects what actually is in effect. */
+#include <alsa/asoundlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "settle.h"
+#include "mixer_trace.h"
+#include "wutil.h"
+
+
+#define MAX_POLL_FDS 16
+/* Blind wait used when confirmation can't be had */
+#define SETTLE_BLIND_NSEC 1000000
+/* A device that never confirmed is given only the blind wait after this many
+ * timed out waits in a row, until SETTLE_RETRY_SEC from the last one */
+#define SETTLE_MAX_FAILURES 3
+#define SETTLE_RETRY_SEC 3600
+
+
+/* Settle state of a device, kept between invocations */
+struct settle_record
+{
+    long long settle_usec;  // Smoothed settle time, -1 if never confirmed.
+    int failures;           // Timed out waits in a row while never confirmed.
+    long long failed_at;    // Wall clock seconds of the last of them.
+};
+
+
+/* State of an ongoing wait, set as the callback private of the element */
+struct settle_wait
+{
+    bool changed;
+    snd_mixer_elem_callback_t prev_cb;
+    void* prev_private;
+};
+
+
+/* Gets id string of the card behind the "default" device to the given
+ * buffer. If the card can't be resolved then "default" is used. */
+static void get_device_id(snd_mixer_t* handle, char* id, size_t size)
+{
+    snd_hctl_t* hctl = NULL;
+    snd_ctl_card_info_t* info = NULL;
+
+    snprintf(id, size, "default");
+    if (snd_ctl_card_info_malloc(&info) < 0) return;
+    if (snd_mixer_get_hctl(handle, "default", &hctl) == 0 &&
+            snd_ctl_card_info(snd_hctl_ctl(hctl), info) == 0) {
+        snprintf(id, size, "%s", snd_ctl_card_info_get_id(info));
+    }
+    snd_ctl_card_info_free(info);
+}
+
+
+/* Gets path of the file storing the settle time of the given device.
+ * Returns false if no suitable directory could be found. */
+static bool get_settle_file_path(char const* device_id, char* path, size_t size)
+{
+    char name[128];
+    snprintf(name, sizeof(name), "settle-%s", device_id);
+    return get_user_file_path("XDG_CACHE_HOME", ".cache", "avolt", name, path, size);
+}
+
+
+/* Loads the settle record of the device, an empty record (no measurement,
+ * no failures) if there is none. */
+static void load_settle_record(char const* device_id, struct settle_record* record)
+{
+    record->settle_usec = -1;
+    record->failures = 0;
+    record->failed_at = 0;
+
+    char path[PATH_MAX];
+    if (!get_settle_file_path(device_id, path, sizeof(path)))
+        return;
+
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+
+    /* Failures are missing from records of older versions */
+    if (fscanf(f, "%lld %d %lld", &record->settle_usec, &record->failures,
+                &record->failed_at) < 1 || record->settle_usec < 0)
+        record->settle_usec = -1;
+    if (record->failures < 0) record->failures = 0;
+    fclose(f);
+}
+
+
+/* Stores the settle record of the device */
+static void store_settle_record(char const* device_id, struct settle_record const* record)
+{
+    char path[PATH_MAX];
+    if (!get_settle_file_path(device_id, path, sizeof(path)))
+        return;
+
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        PD_M("Could not store settle time to: %s\n", path);
+        return;
+    }
+    fprintf(f, "%lld %d %lld\n", record->settle_usec, record->failures,
+            record->failed_at);
+    fclose(f);
+}
+
+
+/* Element callback installed for the duration of a wait. Marks value changes
+ * of the element and passes the event on to the callback it replaced. */
+static int on_settle_event(snd_mixer_elem_t* elem, unsigned int mask)
+{
+    struct settle_wait* wait = snd_mixer_elem_get_callback_private(elem);
+    if (mask & SND_CTL_EVENT_MASK_VALUE)
+        wait->changed = true;
+
+    int ret = 0;
+    if (wait->prev_cb) {
+        snd_mixer_elem_set_callback_private(elem, wait->prev_private);
+        ret = wait->prev_cb(elem, mask);
+        snd_mixer_elem_set_callback_private(elem, wait);
+    }
+    return ret;
+}
+
+
+bool is_playback_volume(snd_mixer_elem_t* elem, long hw_vol)
+{
+    for (int c = 0; c <= SND_MIXER_SCHN_LAST; ++c) {
+        long vol;
+        if (!snd_mixer_selem_has_playback_channel(elem, c)) continue;
+        if (snd_mixer_selem_get_playback_volume(elem, c, &vol) < 0 || vol != hw_vol)
+            return false;
+    }
+    return true;
+}
+
+
+/* Waits until the driver has confirmed that hw_vol written to the playback
+ * channels of the element is in effect, or until timeout_ms has elapsed.
+ * Confirmation means a value change event for the element itself after
+ * which all of its playback channels read back as hw_vol. Time it took is
+ * set to settle_usec.
+ * elem_cb is the callback currently installed on the element (or NULL).
+ * Events seen during the wait are passed on to it and it is restored
+ * afterwards together with its callback private.
+ * Returns true if the value was confirmed. */
+bool wait_playback_volume_settled(
+        snd_mixer_t* handle,
+        snd_mixer_elem_t* elem,
+        long hw_vol,
+        snd_mixer_elem_callback_t elem_cb,
+        int timeout_ms,
+        long long* settle_usec)
+{
+    *settle_usec = 0;
+
+    struct pollfd fds[MAX_POLL_FDS];
+    int nfds = snd_mixer_poll_descriptors_count(handle);
+    if (nfds <= 0 || nfds > MAX_POLL_FDS) return false;
+    nfds = snd_mixer_poll_descriptors(handle, fds, nfds);
+    if (nfds <= 0) return false;
+
+    struct settle_wait wait = {
+        .changed = false,
+        .prev_cb = elem_cb,
+        .prev_private = snd_mixer_elem_get_callback_private(elem),
+    };
+    snd_mixer_elem_set_callback(elem, on_settle_event);
+    snd_mixer_elem_set_callback_private(elem, &wait);
+
+    long long const start = monotonic_usec();
+    long long const deadline = start + (long long)timeout_ms * 1000;
+    bool confirmed = false;
+
+    for (long long now = start; !confirmed && now < deadline; now = monotonic_usec()) {
+        int ret = poll(fds, nfds, (int)((deadline - now + 999) / 1000));
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) break;
+
+        unsigned short revents = 0;
+        snd_mixer_poll_descriptors_revents(handle, fds, nfds, &revents);
+        if (!(revents & POLLIN)) continue;
+        if (snd_mixer_handle_events(handle) < 0) break;
+
+        if (wait.changed) {
+            confirmed = is_playback_volume(elem, hw_vol);
+            wait.changed = false;
+        }
+    }
+
+    snd_mixer_elem_set_callback(elem, wait.prev_cb);
+    snd_mixer_elem_set_callback_private(elem, wait.prev_private);
+
+    *settle_usec = monotonic_usec() - start;
+    PD_M("Settle wait %s after %lli us\n",
+            confirmed ? "confirmed" : "timed out", *settle_usec);
+    return confirmed;
+}
+
+
+/* Waits for hw_vol just written to the element to settle. Timeout of the
+ * wait is derived from the settle time previously measured for the same
+ * device and bounded by [min_timeout_ms, max_timeout_ms]. See
+ * wait_playback_volume_settled() for elem_cb. Confirmed settle
+ * times are stored for later invocations. A device that has never confirmed
+ * a write and has timed out SETTLE_MAX_FAILURES times in a row only gets a
+ * short blind wait, until SETTLE_RETRY_SEC has passed and it is measured
+ * again. */
+void settle_after_write(
+        snd_mixer_t* handle,
+        snd_mixer_elem_t* elem,
+        long hw_vol,
+        snd_mixer_elem_callback_t elem_cb,
+        int min_timeout_ms,
+        int max_timeout_ms)
+{
+    char device_id[64];
+    get_device_id(handle, device_id, sizeof(device_id));
+
+    struct settle_record record;
+    load_settle_record(device_id, &record);
+    long long const now = time(NULL);
+    if (record.settle_usec < 0 && record.failures >= SETTLE_MAX_FAILURES &&
+            now - record.failed_at < SETTLE_RETRY_SEC) {
+        nsleep(SETTLE_BLIND_NSEC);
+        return;
+    }
+
+    /* Allow generous headroom over the earlier measurement */
+    long long const recorded = record.settle_usec;
+    int timeout_ms = max_timeout_ms;
+    if (recorded >= 0) {
+        long long t = recorded * 4 / 1000 + 1;
+        timeout_ms = t < min_timeout_ms ? min_timeout_ms :
+            t > max_timeout_ms ? max_timeout_ms : (int)t;
+    }
+
+    long long settle_usec;
+    if (wait_playback_volume_settled(handle, elem, hw_vol, elem_cb,
+                timeout_ms, &settle_usec)) {
+        /* Smooth the measurement so a single fast settle doesn't shrink the
+         * timeout below what the device usually needs */
+        if (recorded >= 0)
+            settle_usec = (recorded * 3 + settle_usec) / 4;
+        record.settle_usec = settle_usec;
+        record.failures = 0;
+        store_settle_record(device_id, &record);
+    }
+    else if (recorded < 0 && settle_usec >= (long long)timeout_ms * 1000) {
+        /* Never confirmed and the whole wait was spent. After a retry
+         * period one more such wait is enough to stop waiting again. */
+        if (record.failures < SETTLE_MAX_FAILURES) ++record.failures;
+        record.failed_at = now;
+        store_settle_record(device_id, &record);
+    }
+    else if (recorded >= 0 && settle_usec < recorded) {
+        /* Poll failed early, fall back to a blind wait of known length */
+        nsleep((long)(recorded - settle_usec) * 1000);
+    }
+    else if (recorded < 0) {
+        nsleep(SETTLE_BLIND_NSEC);
+    }
+}
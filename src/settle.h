@@ -0,0 +1,27 @@
+#ifndef SETTLE_H_INCLUDED
+#define SETTLE_H_INCLUDED
+
+#include <alsa/asoundlib.h>
+#include <stdbool.h>
+
+
+/* Returns true if all playback channels of the element are at hw_vol */
+bool is_playback_volume(snd_mixer_elem_t* elem, long hw_vol);
+
+bool wait_playback_volume_settled(
+        snd_mixer_t* handle,
+        snd_mixer_elem_t* elem,
+        long hw_vol,
+        snd_mixer_elem_callback_t elem_cb,
+        int timeout_ms,
+        long long* settle_usec);
+
+void settle_after_write(
+        snd_mixer_t* handle,
+        snd_mixer_elem_t* elem,
+        long hw_vol,
+        snd_mixer_elem_callback_t elem_cb,
+        int min_timeout_ms,
+        int max_timeout_ms);
+
+#endif
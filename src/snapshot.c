@@ -0,0 +1,298 @@
+/* Binary snapshots of the mixer elements used by the sound profiles.
+ *
+ * Snapshot file is a header followed by one record per element. Each record
+ * is followed by the volumes of its channels. Values are in host byte order,
+ * snapshots are meant to be restored on the machine which saved them. */
+#include <alsa/asoundlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "alsa_utils.h"
+#include "mixer_trace.h"
+#include "wutil.h"
+
+
+#define SNAPSHOT_MAGIC "AVSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_NAME_SIZE 32
+
+
+struct snapshot_header
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t elem_count;
+    char active_profile[SNAPSHOT_NAME_SIZE];
+};
+
+/* Followed by one int32_t volume per bit set in volume_channels */
+struct snapshot_elem
+{
+    char name[SNAPSHOT_NAME_SIZE];
+    uint32_t volume_channels;   // Channels with a stored volume.
+    uint32_t switch_channels;   // Channels with a stored switch.
+    uint32_t switches;          // Switch states of switch_channels.
+};
+
+/* Restore is done in passes to avoid volume spikes: volumes are lowered
+ * before switches are toggled and raised only after that. */
+enum restore_pass {
+    lower_volumes,
+    switches_off,
+    switches_on,
+    raise_volumes,
+};
+
+
+/* Gets path of snapshot with given name. Names containing '/' are used as
+ * paths as is, others are stored under the per user data directory. */
+bool get_snapshot_path(char const* name, char* path, size_t size)
+{
+    if (strchr(name, '/')) {
+        int len = snprintf(path, size, "%s", name);
+        return len >= 0 && (size_t)len < size;
+    }
+    return get_user_file_path("XDG_DATA_HOME", ".local/share",
+            "avolt/snapshots", name, path, size);
+}
+
+
+/* Adds elem to elems if it is not already there */
+static void add_unique_elem(
+        snd_mixer_elem_t* elem,
+        snd_mixer_elem_t** elems,
+        int* elems_size)
+{
+    if (!elem) return;
+    for (int i = 0; i < *elems_size; ++i) {
+        if (elems[i] == elem) return;
+    }
+    elems[(*elems_size)++] = elem;
+}
+
+
+/* Writes snapshot record of the element to the file */
+static bool write_elem(snd_mixer_elem_t* elem, FILE* f)
+{
+    struct snapshot_elem rec;
+    int32_t volumes[SND_MIXER_SCHN_LAST + 1];
+    int volumes_size = 0;
+
+    memset(&rec, 0, sizeof(rec));
+    strncpy(rec.name, snd_mixer_selem_get_name(elem), SNAPSHOT_NAME_SIZE - 1);
+
+    bool const has_volume = snd_mixer_selem_has_playback_volume(elem);
+    bool const has_switch = snd_mixer_selem_has_playback_switch(elem);
+    for (int c = 0; c <= SND_MIXER_SCHN_LAST; ++c) {
+        if (!snd_mixer_selem_has_playback_channel(elem, c)) continue;
+        if (has_volume) {
+            long vol;
+            snd_mixer_selem_get_playback_volume(elem, c, &vol);
+            rec.volume_channels |= 1u << c;
+            volumes[volumes_size++] = vol;
+        }
+        if (has_switch) {
+            int sw;
+            snd_mixer_selem_get_playback_switch(elem, c, &sw);
+            rec.switch_channels |= 1u << c;
+            if (sw) rec.switches |= 1u << c;
+        }
+    }
+
+    return fwrite(&rec, sizeof(rec), 1, f) == 1 &&
+        fwrite(volumes, sizeof(int32_t), volumes_size, f) == (size_t)volumes_size;
+}
+
+
+/* Saves volumes and switches of all elements of the configs sound profiles,
+ * and name of the active profile, to a snapshot file at path.
+ * Returns false on error. */
+bool save_snapshot(
+        struct avolt_config const* config,
+        struct sound_profile const* active,
+        char const* path)
+{
+    /* Collect elements, shared elements are stored only once */
+    int max_elems = 0;
+    for (int i = 0; i < config->profiles_size; ++i)
+        max_elems += 2 + config->profiles[i].volume_group_size;
+    snd_mixer_elem_t* elems[max_elems > 0 ? max_elems : 1];
+    int elems_size = 0;
+    for (int i = 0; i < config->profiles_size; ++i) {
+        struct sound_profile const* sp = &config->profiles[i];
+        if (!sp->init_ok) continue;
+        add_unique_elem(sp->mixer_element, elems, &elems_size);
+        add_unique_elem(sp->volume_cntrl_mixer_element, elems, &elems_size);
+        for (int j = 0; j < sp->volume_group_size; ++j)
+            add_unique_elem(sp->volume_group[j].mixer_element, elems, &elems_size);
+    }
+
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.elem_count = elems_size;
+    if (active)
+        strncpy(header.active_profile, active->profile_name, SNAPSHOT_NAME_SIZE - 1);
+
+    /* Write to a temporary file first so that a failed save doesn't destroy
+     * an earlier snapshot */
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path))
+        return false;
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        fprintf(stderr, "avolt ERROR: Could not open snapshot '%s': %s\n",
+                tmp_path, strerror(errno));
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (int i = 0; ok && i < elems_size; ++i)
+        ok = write_elem(elems[i], f);
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "avolt ERROR: Could not write snapshot '%s'.\n", path);
+        remove(tmp_path);
+        return false;
+    }
+    PD_M("Saved snapshot of %i elements to: %s\n", elems_size, path);
+    return true;
+}
+
+
+/* Applies the part of snapshot record belonging to the given pass, only
+ * values which differ from the live values are written.
+ * Returns number of writes done. */
+static int restore_elem(
+        snd_mixer_elem_t* elem,
+        struct snapshot_elem const* rec,
+        int32_t const* volumes,
+        enum restore_pass pass)
+{
+    int writes = 0;
+    int v = 0;
+    for (int c = 0; c <= SND_MIXER_SCHN_LAST; ++c) {
+        if (rec->volume_channels & (1u << c)) {
+            long const stored = volumes[v++];
+            long live;
+            bool const lower = pass == lower_volumes;
+            if ((lower || pass == raise_volumes) &&
+                    snd_mixer_selem_has_playback_channel(elem, c) &&
+                    snd_mixer_selem_get_playback_volume(elem, c, &live) == 0 &&
+                    (lower ? stored < live : stored > live)) {
+                snd_mixer_selem_set_playback_volume(elem, c, stored);
+                ++writes;
+            }
+        }
+        if (rec->switch_channels & (1u << c)) {
+            int const stored = (rec->switches >> c) & 1;
+            int live;
+            if ((pass == switches_off || pass == switches_on) &&
+                    stored == (pass == switches_on) &&
+                    snd_mixer_selem_has_playback_channel(elem, c) &&
+                    snd_mixer_selem_get_playback_switch(elem, c, &live) == 0 &&
+                    !live != !stored) {
+                snd_mixer_selem_set_playback_switch(elem, c, stored);
+                ++writes;
+            }
+        }
+    }
+    return writes;
+}
+
+
+/* Counts set bits */
+static int count_channels(uint32_t channels)
+{
+    int count = 0;
+    for (; channels; channels &= channels - 1)
+        ++count;
+    return count;
+}
+
+
+/* Restores snapshot file at path to the mixer. Only values differing from
+ * the live values are written, the number of writes is set to writes and
+ * name of the profile active at save time to active_profile.
+ * Elements missing from the mixer are skipped.
+ * Returns false if the snapshot couldn't be read. */
+bool restore_snapshot(
+        snd_mixer_t* handle,
+        char const* path,
+        int* writes,
+        char* active_profile,
+        size_t active_profile_size)
+{
+    *writes = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "avolt ERROR: Could not open snapshot '%s': %s\n",
+                path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct snapshot_header))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "avolt ERROR: Could not read snapshot '%s'.\n", path);
+        return false;
+    }
+
+    char const* const begin = map;
+    char const* const end = begin + st.st_size;
+    struct snapshot_header const* header = map;
+    bool ok = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == SNAPSHOT_VERSION;
+
+    /* Validate the records before touching the mixer */
+    char const* p = begin + sizeof(*header);
+    for (int i = 0; ok && i < header->elem_count; ++i) {
+        struct snapshot_elem const* rec = (struct snapshot_elem const*)p;
+        ok = p + sizeof(*rec) <= end;
+        if (ok) {
+            p += sizeof(*rec) + count_channels(rec->volume_channels) * sizeof(int32_t);
+            ok = p <= end;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "avolt ERROR: '%s' is not a valid version %i snapshot.\n",
+                path, SNAPSHOT_VERSION);
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    for (enum restore_pass pass = lower_volumes; pass <= raise_volumes; ++pass) {
+        p = begin + sizeof(*header);
+        for (int i = 0; i < header->elem_count; ++i) {
+            struct snapshot_elem const* rec = (struct snapshot_elem const*)p;
+            int32_t const* volumes = (int32_t const*)(p + sizeof(*rec));
+            p += sizeof(*rec) + count_channels(rec->volume_channels) * sizeof(int32_t);
+
+            char name[SNAPSHOT_NAME_SIZE + 1];
+            memcpy(name, rec->name, SNAPSHOT_NAME_SIZE);
+            name[SNAPSHOT_NAME_SIZE] = '\0';
+            snd_mixer_elem_t* elem = get_elem(handle, name);
+            if (elem)
+                *writes += restore_elem(elem, rec, volumes, pass);
+        }
+    }
+
+    snprintf(active_profile, active_profile_size, "%.*s",
+            SNAPSHOT_NAME_SIZE, header->active_profile);
+    PD_M("Restored snapshot '%s' with active profile '%s' in %i writes\n",
+            path, active_profile, *writes);
+    munmap(map, st.st_size);
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+#include <alsa/asoundlib.h>
+#include <stdbool.h>
+
+#include "avolt.conf.h"
+
+
+bool get_snapshot_path(char const* name, char* path, size_t size);
+
+bool save_snapshot(
+        struct avolt_config const* config,
+        struct sound_profile const* active,
+        char const* path);
+
+bool restore_snapshot(
+        snd_mixer_t* handle,
+        char const* path,
+        int* writes,
+        char* active_profile,
+        size_t active_profile_size);
+
+#endif
@@ -0,0 +1,171 @@
+/* Streaming volume input, see stream.h. */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stream.h"
+#include "avolt.conf.h"
+#include "wutil.h"
+
+
+#define STREAM_TOKEN_SIZE 32
+
+
+/* Stream state between reads */
+struct stream_state
+{
+    char token[STREAM_TOKEN_SIZE];  // Delta split between reads.
+    size_t token_size;
+    double pending;                 // Sum of deltas of the current frame.
+    double carry;                   // Fractional part left from earlier frames.
+    long long frame_end_usec;       // 0 if no deltas pending.
+    int frame_ms;
+};
+
+
+/* Adds a complete delta token to the pending sum */
+static void add_delta(struct stream_state* state, bool verbose)
+{
+    state->token[state->token_size] = '\0';
+    state->token_size = 0;
+
+    char* end = NULL;
+    double const delta = strtod(state->token, &end);
+    if (end == state->token || *end != '\0') {
+        if (verbose) fprintf(stderr, "avolt: Ignoring invalid delta '%s'.\n", state->token);
+        return;
+    }
+    if (state->frame_end_usec == 0)
+        state->frame_end_usec = monotonic_usec() + state->frame_ms * 1000LL;
+    state->pending += delta;
+}
+
+
+/* Splits read data to delta tokens */
+static void parse_input(
+        struct stream_state* state,
+        char const* buf,
+        size_t size,
+        bool verbose)
+{
+    for (size_t i = 0; i < size; ++i) {
+        bool const space = buf[i] == ' ' || buf[i] == '\n' ||
+            buf[i] == '\t' || buf[i] == '\r';
+        if (!space) {
+            /* Overlong tokens are truncated and then rejected by strtod */
+            if (state->token_size < STREAM_TOKEN_SIZE - 1)
+                state->token[state->token_size++] = buf[i];
+        } else if (state->token_size > 0) {
+            add_delta(state, verbose);
+        }
+    }
+}
+
+
+/* Applies the whole steps of the frame as one relative change. A change
+ * of 100 already spans the whole volume range, so the total is clamped to
+ * [-100,100] before the fraction is carried to the next frame. */
+static bool apply_frame(
+        struct avolt_ctx* ctx,
+        struct stream_state* state,
+        bool verbose)
+{
+    double total = state->carry + state->pending;
+    if (total > 100) total = 100;
+    if (total < -100) total = -100;
+    long int const step = (long int)total;
+    state->carry = total - step;
+    state->pending = 0;
+    state->frame_end_usec = 0;
+    if (step == 0) return true;
+
+    bool const ok = avolt_set_volume(ctx, step, step > 0);
+    if (verbose) printf("Changed volume by %li%s\n", step, ok ? "" : " (failed)");
+    return ok;
+}
+
+
+/* Reads volume deltas from path, or stdin if path is NULL, until end of
+ * input and applies them in frames. A FIFO given as path is reopened after
+ * its writers have closed it, so then the stream ends only on errors.
+ * Returns false on errors. */
+bool run_volume_stream(struct avolt_ctx* ctx, char const* path, bool verbose)
+{
+    struct stream_state state = {
+        .token_size = 0,
+        .pending = 0,
+        .carry = 0,
+        .frame_end_usec = 0,
+        .frame_ms = avolt_get_config(ctx)->stream_frame_ms,
+    };
+
+    int input_fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (input_fd < 0) {
+        fprintf(stderr, "avolt ERROR: Could not open stream '%s': %s\n",
+                path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    bool const reopen = path && fstat(input_fd, &st) == 0 && S_ISFIFO(st.st_mode);
+
+    /* Mixer events keep the cached volumes current for relative changes */
+    struct pollfd fds[2] = {
+        { .fd = input_fd, .events = POLLIN },
+        { .fd = avolt_get_fd(ctx), .events = POLLIN },
+    };
+
+    bool ret = true;
+    while (true) {
+        int timeout = -1;
+        if (state.frame_end_usec) {
+            long long const left = state.frame_end_usec - monotonic_usec();
+            timeout = left > 0 ? (left + 999) / 1000 : 0;
+        }
+
+        int const n = poll(fds, 2, timeout);
+        if (n < 0 && errno != EINTR) {
+            ret = false;
+            break;
+        }
+        if (n > 0 && fds[1].revents) avolt_handle_events(ctx);
+
+        if (n > 0 && fds[0].revents) {
+            char buf[256];
+            ssize_t const size = read(input_fd, buf, sizeof(buf));
+            if (size > 0) {
+                parse_input(&state, buf, size, verbose);
+            } else if (size == 0 || errno != EINTR) {
+                /* End of input finishes the current delta and frame */
+                if (state.token_size > 0) add_delta(&state, verbose);
+                if (state.frame_end_usec && !apply_frame(ctx, &state, verbose))
+                    ret = false;
+                if (size < 0 || !reopen) {
+                    ret = ret && size == 0;
+                    break;
+                }
+                close(input_fd);
+                input_fd = open(path, O_RDONLY);
+                if (input_fd < 0) {
+                    ret = false;
+                    break;
+                }
+                fds[0].fd = input_fd;
+                continue;
+            }
+        }
+
+        if (state.frame_end_usec && monotonic_usec() >= state.frame_end_usec &&
+                !apply_frame(ctx, &state, verbose))
+            ret = false;
+    }
+
+    if (path && input_fd >= 0) close(input_fd);
+    return ret;
+}
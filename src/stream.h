@@ -0,0 +1,19 @@
+#ifndef STREAM_H_INCLUDED
+#define STREAM_H_INCLUDED
+/* Streaming volume input for scroll wheels and rotary encoders.
+ *
+ * Relative volume deltas (for example "+1", "-1" or "0.25") separated by
+ * whitespace are read from a file descriptor. Deltas arriving within one
+ * frame (stream_frame_ms of the configuration) are summed and applied as one
+ * relative volume change. The fractional part of the sum is carried to the
+ * next frame, so sub-step deltas add up instead of being rounded away.
+ */
+
+#include <stdbool.h>
+
+#include "libavolt.h"
+
+
+bool run_volume_stream(struct avolt_ctx* ctx, char const* path, bool verbose);
+
+#endif
@@ -0,0 +1,378 @@
+/* Transient analysis of output switching, see transient.h. */
+
+/* Sampler reads go straight to alsa-lib, only the analysed writes are
+ * traced */
+#define MIXER_TRACE_NO_REDIRECT
+#include <alsa/asoundlib.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "transient.h"
+#include "alsa_utils.h"
+#include "avolt.conf.h"
+#include "mixer_trace.h"
+#include "wutil.h"
+
+
+#define TRANSIENT_MAX_OUTPUTS 16
+#define TRANSIENT_MAX_SAMPLES 65536
+#define TRANSIENT_MAX_WRITES 256
+/* Levels closer than this to the reference are not transients */
+#define TRANSIENT_THRESHOLD_DB 0.5
+
+
+/* Sampled output of a sound profile */
+struct sampled_output
+{
+    char const* name;
+    snd_mixer_elem_t* switch_elem;  // NULL if same as volume_elem.
+    snd_mixer_elem_t* volume_elem;
+    uint32_t channels;              // Playback channel mask of volume_elem.
+    bool has_switch;                // Of volume_elem.
+};
+
+/* Mixer write made during the analysis */
+struct logged_write
+{
+    long long time_ns;
+    int op;
+    char elem[TRACE_NAME_SIZE];
+    int channel;
+    long long value;
+    int ret;
+};
+
+
+static snd_mixer_t* sampler_handle = NULL;
+static struct sampled_output outputs[TRANSIENT_MAX_OUTPUTS];
+static int outputs_size = 0;
+/* Profiles whose volume control element has no dB information */
+static char const* unmeasurable[TRANSIENT_MAX_OUTPUTS];
+static int unmeasurable_size = 0;
+
+/* Sample i was taken at sample_times[i], level of output o is
+ * sample_levels[i * outputs_size + o] in dB */
+static long long* sample_times = NULL;
+static double* sample_levels = NULL;
+static int samples_size = 0;
+static long long sample_period_ns;
+static int tail_ms;
+
+static struct logged_write writes[TRANSIENT_MAX_WRITES];
+static int writes_size = 0;
+
+static pthread_t sampler_thread;
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long stop_at_ns = 0;    // Protected by sampler_lock.
+
+
+/* Gets current output level of the profile in dB, -INFINITY if muted and NAN
+ * if no unmuted channel could be read */
+static double get_output_level(struct sampled_output const* out)
+{
+    int sw = 1;
+    if (out->switch_elem &&
+            snd_mixer_selem_get_playback_switch(out->switch_elem,
+                SND_MIXER_SCHN_FRONT_LEFT, &sw) == 0 && !sw)
+        return -INFINITY;
+
+    double level = -INFINITY;
+    bool unread = false;
+    for (int ch = 0; ch <= SND_MIXER_SCHN_LAST; ++ch) {
+        if (!(out->channels & (1u << ch))) continue;
+        if (out->has_switch &&
+                snd_mixer_selem_get_playback_switch(out->volume_elem, ch, &sw) == 0 &&
+                !sw)
+            continue;
+        long dB;
+        if (snd_mixer_selem_get_playback_dB(out->volume_elem, ch, &dB) != 0) {
+            unread = true;
+            continue;
+        }
+        if (dB / 100.0 > level) level = dB / 100.0;
+    }
+    return unread && isinf(level) ? NAN : level;
+}
+
+
+/* Takes a sample of all outputs, returns false if the buffer is full */
+static bool take_sample(void)
+{
+    if (samples_size == TRANSIENT_MAX_SAMPLES) return false;
+
+    /* Values are cached by the handle, bring them up to date first */
+    snd_mixer_handle_events(sampler_handle);
+    sample_times[samples_size] = monotonic_nsec();
+    for (int o = 0; o < outputs_size; ++o) {
+        sample_levels[samples_size * outputs_size + o] =
+            get_output_level(&outputs[o]);
+    }
+    ++samples_size;
+    return true;
+}
+
+
+static void* sampler_main(void* arg)
+{
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (true) {
+        next.tv_nsec += sample_period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            ++next.tv_sec;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        if (!take_sample()) break;
+
+        pthread_mutex_lock(&sampler_lock);
+        bool const stop = stop_at_ns && sample_times[samples_size - 1] >= stop_at_ns;
+        pthread_mutex_unlock(&sampler_lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+
+/* Logs the mixer writes, called by mixer_trace */
+static void log_write(
+        struct trace_record const* record,
+        snd_mixer_elem_t* elem,
+        long long start_ns,
+        void* data)
+{
+    switch (record->op) {
+        case trace_op_snd_mixer_selem_set_playback_volume:
+        case trace_op_snd_mixer_selem_set_playback_dB:
+        case trace_op_snd_mixer_selem_set_playback_switch:
+        case trace_op_snd_mixer_selem_set_playback_volume_all:
+        case trace_op_snd_mixer_selem_set_playback_dB_all:
+        case trace_op_snd_mixer_selem_set_playback_switch_all:
+            break;
+        default:
+            return;
+    }
+    if (writes_size == TRANSIENT_MAX_WRITES) return;
+
+    struct logged_write* w = &writes[writes_size++];
+    w->time_ns = start_ns;
+    w->op = record->op;
+    strncpy(w->elem, elem ? snd_mixer_selem_get_name(elem) : "-", TRACE_NAME_SIZE - 1);
+    w->elem[TRACE_NAME_SIZE - 1] = '\0';
+    w->channel = record->channel;
+    w->value = record->u.call.in[0];
+    w->ret = record->ret;
+}
+
+
+/* Starts sampling the outputs of the profiles of ctx, and logging writes.
+ * Returns false if there is nothing to sample. */
+bool transient_start(struct avolt_ctx* ctx)
+{
+    struct avolt_config const* config = avolt_get_config(ctx);
+    if (config->transient_sample_rate_hz <= 0) return false;
+
+    /* Own handle so that sampling does not need the context lock */
+    sampler_handle = get_handle();
+    outputs_size = 0;
+    unmeasurable_size = 0;
+    for (int i = 0; i < config->profiles_size &&
+            outputs_size < TRANSIENT_MAX_OUTPUTS; ++i) {
+        struct sound_profile const* sp = &config->profiles[i];
+        if (!sp->init_ok) continue;
+
+        struct sampled_output* out = &outputs[outputs_size];
+        out->name = sp->profile_name;
+        out->volume_elem = get_elem(sampler_handle,
+                sp->volume_cntrl_mixer_element_name ?
+                sp->volume_cntrl_mixer_element_name : sp->mixer_element_name);
+        out->switch_elem = get_elem(sampler_handle, sp->mixer_element_name);
+        if (!out->volume_elem || !out->switch_elem) continue;
+        if (out->switch_elem == out->volume_elem ||
+                !snd_mixer_selem_has_playback_switch(out->switch_elem))
+            out->switch_elem = NULL;
+
+        /* Levels of elements without dB information are not known */
+        long dB_min, dB_max;
+        if (!snd_mixer_selem_has_playback_volume(out->volume_elem) ||
+                snd_mixer_selem_get_playback_dB_range(out->volume_elem,
+                    &dB_min, &dB_max) != 0 ||
+                dB_min >= dB_max) {
+            if (unmeasurable_size < TRANSIENT_MAX_OUTPUTS)
+                unmeasurable[unmeasurable_size++] = sp->profile_name;
+            continue;
+        }
+        out->has_switch = snd_mixer_selem_has_playback_switch(out->volume_elem);
+        out->channels = 0;
+        for (int ch = 0; ch <= SND_MIXER_SCHN_LAST; ++ch) {
+            if (snd_mixer_selem_has_playback_channel(out->volume_elem, ch))
+                out->channels |= 1u << ch;
+        }
+        ++outputs_size;
+    }
+
+    sample_times = malloc(TRANSIENT_MAX_SAMPLES * sizeof(*sample_times));
+    sample_levels = malloc(TRANSIENT_MAX_SAMPLES * outputs_size * sizeof(*sample_levels));
+    if (outputs_size == 0 || !sample_times || !sample_levels) {
+        fprintf(stderr, "avolt ERROR: No outputs with dB information to sample for transient analysis.\n");
+        free(sample_times);
+        free(sample_levels);
+        snd_mixer_close(sampler_handle);
+        return false;
+    }
+
+    sample_period_ns = 1000000000LL / config->transient_sample_rate_hz;
+    tail_ms = config->transient_tail_ms;
+    samples_size = 0;
+    writes_size = 0;
+    stop_at_ns = 0;
+
+    /* Reference level before anything is written */
+    take_sample();
+    if (!mixer_trace_set_observer(log_write, NULL)) {
+        fprintf(stderr, "avolt ERROR: Transient analysis needs a build with D_AVOLT_TRACE.\n");
+        free(sample_times);
+        free(sample_levels);
+        snd_mixer_close(sampler_handle);
+        return false;
+    }
+    if (pthread_create(&sampler_thread, NULL, sampler_main, NULL) != 0) {
+        mixer_trace_set_observer(NULL, NULL);
+        free(sample_times);
+        free(sample_levels);
+        snd_mixer_close(sampler_handle);
+        return false;
+    }
+    return true;
+}
+
+
+/* Loudest output of sample i, output index to *loudest. NAN if no output
+ * could be read. */
+static double get_sample_level(int i, int* loudest)
+{
+    double level = -INFINITY;
+    bool read = false;
+    *loudest = 0;
+    for (int o = 0; o < outputs_size; ++o) {
+        double const output_level = sample_levels[i * outputs_size + o];
+        if (isnan(output_level)) continue;
+        read = true;
+        if (output_level > level) {
+            level = output_level;
+            *loudest = o;
+        }
+    }
+    return read ? level : NAN;
+}
+
+
+static char const* format_level(double level, char* buf, size_t size)
+{
+    if (isnan(level)) snprintf(buf, size, "unmeasurable");
+    else if (isinf(level)) snprintf(buf, size, "muted");
+    else snprintf(buf, size, "%.2f dB", level);
+    return buf;
+}
+
+
+static void print_report(FILE* output)
+{
+    char b1[32], b2[32];
+    long long const t0 = sample_times[0];
+    int first_out, last_out, peak_out;
+    double const first = get_sample_level(0, &first_out);
+    double const last = get_sample_level(samples_size - 1, &last_out);
+    double const reference = first > last ? first : last;
+
+    fprintf(output, "Sampled %i outputs %i times over %.3f ms.\n",
+            outputs_size, samples_size, (sample_times[samples_size - 1] - t0) / 1e6);
+    if (unmeasurable_size > 0) {
+        fprintf(output, "Not sampled, no dB information:");
+        for (int i = 0; i < unmeasurable_size; ++i)
+            fprintf(output, " %s", unmeasurable[i]);
+        fprintf(output, "\n");
+    }
+    if (samples_size == TRANSIENT_MAX_SAMPLES)
+        fprintf(output, "Sample buffer filled, end of the operation was not sampled.\n");
+    fprintf(output, "Level before: %s (%s), after: %s (%s)\n",
+            format_level(first, b1, sizeof(b1)), outputs[first_out].name,
+            format_level(last, b2, sizeof(b2)), outputs[last_out].name);
+
+    /* Peak and the run of samples above the reference around it */
+    int peak = 0;
+    double peak_level = -INFINITY;
+    for (int i = 0; i < samples_size; ++i) {
+        int o;
+        double const level = get_sample_level(i, &o);
+        if (level > peak_level) {
+            peak_level = level;
+            peak = i;
+        }
+    }
+    double const limit = isinf(reference) ? reference : reference + TRANSIENT_THRESHOLD_DB;
+    int run_start = peak, run_end = peak;
+    if (peak_level > limit) {
+        int o;
+        while (run_start > 0 && get_sample_level(run_start - 1, &o) > limit) --run_start;
+        while (run_end + 1 < samples_size && get_sample_level(run_end + 1, &o) > limit) ++run_end;
+        get_sample_level(peak, &peak_out);
+
+        long long const end_ns = run_end + 1 < samples_size ?
+            sample_times[run_end + 1] : sample_times[run_end];
+        if (isinf(reference))
+            fprintf(output, "Transient: %s from muted", format_level(peak_level, b1, sizeof(b1)));
+        else
+            fprintf(output, "Transient: %+.2f dB above %s",
+                    peak_level - reference, format_level(reference, b1, sizeof(b1)));
+        fprintf(output, " on %s at %.3f ms, lasted %.3f ms (%i samples).\n",
+                outputs[peak_out].name, (sample_times[peak] - t0) / 1e6,
+                (end_ns - sample_times[run_start]) / 1e6, run_end - run_start + 1);
+    } else {
+        fprintf(output, "No transient, peak %s.\n",
+                format_level(peak_level, b1, sizeof(b1)));
+    }
+
+    /* Writes which happened before the first loud sample, after the last
+     * quiet one, or during the transient are marked */
+    long long const cause_from = peak_level > limit && run_start > 0 ?
+        sample_times[run_start - 1] : LLONG_MAX;
+    long long const cause_to = sample_times[run_end];
+    fprintf(output, "Writes%s:\n", peak_level > limit ? " (* before or during the transient)" : "");
+    for (int i = 0; i < writes_size; ++i) {
+        struct logged_write const* w = &writes[i];
+        bool const cause = w->time_ns >= cause_from && w->time_ns <= cause_to;
+        fprintf(output, "%c %9.3f ms  %s(%s, ch %i, %lli) = %i\n",
+                cause ? '*' : ' ', (w->time_ns - t0) / 1e6,
+                trace_op_name(w->op), w->elem, w->channel, w->value, w->ret);
+    }
+}
+
+
+/* Samples for the configured tail time, stops the analysis and prints the
+ * report to output. */
+void transient_stop(FILE* output)
+{
+    pthread_mutex_lock(&sampler_lock);
+    stop_at_ns = monotonic_nsec() + tail_ms * 1000000LL;
+    pthread_mutex_unlock(&sampler_lock);
+    pthread_join(sampler_thread, NULL);
+    mixer_trace_set_observer(NULL, NULL);
+
+    print_report(output);
+
+    snd_mixer_close(sampler_handle);
+    sampler_handle = NULL;
+    free(sample_times);
+    free(sample_levels);
+    sample_times = NULL;
+    sample_levels = NULL;
+}
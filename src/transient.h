@@ -0,0 +1,28 @@
+#ifndef TRANSIENT_H_INCLUDED
+#define TRANSIENT_H_INCLUDED
+/* Transient analysis of output switching.
+ *
+ * While an analysis runs, a sampler thread reads the output level of every
+ * initialized sound profile from its own mixer handle at a fixed rate, and
+ * the mixer writes made through the traced functions (mixer_trace.h) are
+ * logged with their start times. The output level of a profile is the
+ * highest channel dB of its volume control element, with channels whose
+ * switch is off and profiles whose mixer element switch is off counted as
+ * muted. Profiles whose volume control element has no dB information can not
+ * be measured, they are not sampled but listed in the report. A transient
+ * is a run of samples where the loudest output is above both its level
+ * before and its level after the analysed operation.
+ * Logging the writes needs a build with D_AVOLT_TRACE.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "libavolt.h"
+
+
+bool transient_start(struct avolt_ctx* ctx);
+
+void transient_stop(FILE* output);
+
+#endif
@@ -6,6 +6,8 @@
 
 #include "volume_change.h"
 #include "volume_mapping.h"
+#include "mixer_trace.h"
+#include "probes.h"
 #include "wutil.h"
 
 
@@ -23,48 +25,72 @@ void set_vol(
         int round_direction);
 
 
+void set_profile_vol(
+        struct sound_profile* sp,
+        enum Volume_type volume_type,
+        long int new_vol,
+        int round_direction);
+
+
 /* Gets mixer volume with given type, if left and right channel volume differ,
  * then gives the larger one.
  * In case of an error returns "-1". */
 void get_vol(snd_mixer_elem_t* elem, enum Volume_type volume_type, long int* vol)
 {
-    long int l, r;
+    AVOLT_PROBE_ENTRY(get_vol, elem, volume_type, probe_hw_vol(elem), -1);
+    int err = 0;
+    long int l = -1, r = -1;
+    /* Mono elements have only the left channel */
+    bool const has_right = snd_mixer_selem_has_playback_channel(elem,
+            SND_MIXER_SCHN_FRONT_RIGHT);
     if (volume_type == hardware) {
-        // TODO: check return value (int) for errors
-        snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT, &l);
-        snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT, &r);
+        err = snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT, &l);
+        r = l;
+        if (!err && has_right)
+            err = snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT, &r);
     }
     else if (volume_type == decibels) {
-        // TODO: check return value (int) for errors
-        snd_mixer_selem_get_playback_dB(elem, SND_MIXER_SCHN_FRONT_LEFT, &l);
-        snd_mixer_selem_get_playback_dB(elem, SND_MIXER_SCHN_FRONT_RIGHT, &r);
+        err = snd_mixer_selem_get_playback_dB(elem, SND_MIXER_SCHN_FRONT_LEFT, &l);
+        r = l;
+        if (!err && has_right)
+            err = snd_mixer_selem_get_playback_dB(elem, SND_MIXER_SCHN_FRONT_RIGHT, &r);
     }
     else if (volume_type == alsa_percentage) {
-        double l_norm = get_normalized_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT);
-        double r_norm = get_normalized_playback_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT);
-        PD_M("Got alsa_percentage volumes: %g, %g\n", l_norm, r_norm);
-        l = lround(l_norm*100);
-        r = lround(r_norm*100);
+        /* Normalized volumes are 0 on read errors, so check the raw volume
+         * can be read */
+        err = snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT, &l);
+        if (!err) {
+            double l_norm = get_normalized_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT);
+            double r_norm = has_right ?
+                get_normalized_playback_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT) : l_norm;
+            PD_M("Got alsa_percentage volumes: %g, %g\n", l_norm, r_norm);
+            l = lround(l_norm*100);
+            r = lround(r_norm*100);
+        }
     }
     else if (volume_type == hardware_percentage) {
         long int min, max;
-        snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-        snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT, &l);
-        snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT, &r);
-
-        long int vol_to_percentage = l >= r ? l : r;
-        change_range(&vol_to_percentage, min, max, 0, 100, false);
-        *vol = vol_to_percentage;
-        return;
+        err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+        if (!err)
+            err = snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT, &l);
+        r = l;
+        if (!err && has_right)
+            err = snd_mixer_selem_get_playback_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT, &r);
+
+        if (!err) {
+            l = l >= r ? l : r;
+            change_range(&l, min, max, 0, 100, false);
+            r = l;
+        }
     }
     else {
         // Error
-        l = -1;
-        r = -1;
+        err = -1;
     }
 
-    *vol = l >= r ? l : r;
+    *vol = err ? -1 : l >= r ? l : r;
     PD_M("get_vol returns: %li\n", *vol);
+    AVOLT_PROBE_RETURN(get_vol, elem, volume_type, probe_hw_vol(elem), *vol, err);
 }
 
 
@@ -78,6 +104,11 @@ void set_vol(
         int round_direction)
 {
     // TODO: possibly add new_vol range check
+    AVOLT_PROBE_ENTRY(set_vol, elem, volume_type, probe_hw_vol(elem), new_vol);
+#ifdef D_AVOLT_USDT
+    long const old_hw_vol = AVOLT_PROBE_ENABLED(set_vol_return) ?
+        probe_hw_vol(elem) : -1;
+#endif
     int err = 0;
 
     if (volume_type == hardware) {
@@ -109,6 +140,191 @@ void set_vol(
     if (err != 0) {
         fprintf(stderr, "avolt ERROR: snd mixer set playback volume failed with new vol '%li' and volume type '%i'.\n", new_vol, volume_type);
     }
+    AVOLT_PROBE_RETURN(set_vol, elem, volume_type, old_hw_vol, probe_hw_vol(elem), err);
+}
+
+
+/* Hardware volume to write to one channel of an element */
+struct channel_write
+{
+    snd_mixer_elem_t* elem;
+    snd_mixer_selem_channel_id_t channel;
+    long int hw_vol;
+};
+
+
+/* Converts volume of given type to hardware volume of the element, the
+ * result is clamped to the hardware range.
+ * Returns non-zero on error. */
+int to_hw_vol(
+        snd_mixer_elem_t* elem,
+        enum Volume_type volume_type,
+        long int vol,
+        int round_direction,
+        long int* hw_vol)
+{
+    long int min, max;
+    int err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+    if (err) return err;
+
+    if (volume_type == hardware) {
+        *hw_vol = vol;
+    }
+    else if (volume_type == decibels) {
+        err = snd_mixer_selem_ask_playback_dB_vol(elem, vol, round_direction, hw_vol);
+    }
+    else if (volume_type == alsa_percentage) {
+        err = get_normalized_playback_raw_volume(elem, (double) vol / 100,
+                round_direction, hw_vol);
+    }
+    else if (volume_type == hardware_percentage) {
+        change_range(&vol, 0, 100, min, max, false);
+        *hw_vol = vol;
+    }
+    else {
+        err = -1;
+    }
+    if (err) return err;
+
+    if (*hw_vol < min) *hw_vol = min;
+    if (*hw_vol > max) *hw_vol = max;
+    return 0;
+}
+
+
+/* Converts hardware volume of the element to volume of given type, without
+ * reading the element.
+ * Returns non-zero on error. */
+static int from_hw_vol(
+        snd_mixer_elem_t* elem,
+        enum Volume_type volume_type,
+        long int hw_vol,
+        long int* vol)
+{
+    long int min, max;
+    int err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+    if (err) return err;
+    if (hw_vol < min) hw_vol = min;
+    if (hw_vol > max) hw_vol = max;
+
+    if (volume_type == hardware) {
+        *vol = hw_vol;
+    }
+    else if (volume_type == decibels) {
+        err = snd_mixer_selem_ask_playback_vol_dB(elem, hw_vol, vol);
+    }
+    else if (volume_type == alsa_percentage) {
+        double norm;
+        err = get_raw_normalized_playback_volume(elem, hw_vol, &norm);
+        if (!err) *vol = lround(norm*100);
+    }
+    else if (volume_type == hardware_percentage) {
+        if (min == max) *vol = 0;
+        else {
+            *vol = hw_vol;
+            change_range(vol, min, max, 0, 100, false);
+        }
+    }
+    else {
+        err = -1;
+    }
+    return err;
+}
+
+
+/* Adds writes of hw_vol to all playback channels of the element */
+static void add_channel_writes(
+        snd_mixer_elem_t* elem,
+        long int hw_vol,
+        struct channel_write* writes,
+        int* writes_size)
+{
+    for (int c = 0; c <= SND_MIXER_SCHN_LAST; ++c) {
+        if (!snd_mixer_selem_has_playback_channel(elem, c)) continue;
+        writes[*writes_size].elem = elem;
+        writes[*writes_size].channel = c;
+        writes[*writes_size].hw_vol = hw_vol;
+        ++*writes_size;
+    }
+}
+
+
+/* Sets volume of the profiles volume control element and its volume group.
+ * Volumes of all channels of all group members are computed first and then
+ * written in one pass, so the elements change as close together as possible.
+ * Without a volume group this is set_vol of the volume control element. */
+void set_profile_vol(
+        struct sound_profile* sp,
+        enum Volume_type volume_type,
+        long int new_vol,
+        int round_direction)
+{
+    if (sp->volume_group_size == 0) {
+        set_vol(sp->volume_cntrl_mixer_element, volume_type, new_vol, round_direction);
+        return;
+    }
+
+    struct channel_write writes[(1 + sp->volume_group_size) * (SND_MIXER_SCHN_LAST + 1)];
+    int writes_size = 0;
+
+    long int profile_hw_vol, hw_vol, min, _;
+    snd_mixer_elem_t* elem = sp->volume_cntrl_mixer_element;
+    if (to_hw_vol(elem, volume_type, new_vol, round_direction, &profile_hw_vol) != 0) {
+        fprintf(stderr, "avolt ERROR: Could not convert volume '%li' of type '%i' for element '%s'.\n",
+                new_vol, volume_type, sp->volume_cntrl_mixer_element_name);
+        return;
+    }
+    add_channel_writes(elem, profile_hw_vol, writes, &writes_size);
+    snd_mixer_selem_get_playback_volume_range(elem, &min, &_);
+    bool const to_min = profile_hw_vol == min;
+
+    for (int i = 0; i < sp->volume_group_size; ++i) {
+        struct volume_group_member const* m = &sp->volume_group[i];
+        if (!m->mixer_element) continue;
+
+        if (to_min) {
+            snd_mixer_selem_get_playback_volume_range(m->mixer_element, &hw_vol, &_);
+            PD_M("set_profile_vol: group member '%s' to its minimum %li\n",
+                    m->mixer_element_name, hw_vol);
+            add_channel_writes(m->mixer_element, hw_vol, writes, &writes_size);
+            continue;
+        }
+
+        /* Scale and offset apply to the profile volume in the member type,
+         * whatever type new_vol was given in */
+        long int profile_vol;
+        if (from_hw_vol(elem, m->volume_type, profile_hw_vol, &profile_vol) != 0) {
+            fprintf(stderr, "avolt ERROR: Could not convert the volume of element '%s' for group member '%s'.\n",
+                    sp->volume_cntrl_mixer_element_name, m->mixer_element_name);
+            continue;
+        }
+        long int member_vol = lround(profile_vol * m->scale) + m->offset;
+        if (m->volume_type == alsa_percentage || m->volume_type == hardware_percentage)
+            member_vol = member_vol < 0 ? 0 : member_vol > 100 ? 100 : member_vol;
+
+        if (to_hw_vol(m->mixer_element, m->volume_type, member_vol,
+                    round_direction, &hw_vol) != 0) {
+            fprintf(stderr, "avolt ERROR: Could not convert volume '%li' for group member '%s'.\n",
+                    member_vol, m->mixer_element_name);
+            continue;
+        }
+        PD_M("set_profile_vol: group member '%s' to hardware volume %li\n",
+                m->mixer_element_name, hw_vol);
+        add_channel_writes(m->mixer_element, hw_vol, writes, &writes_size);
+    }
+
+    for (int i = 0; i < writes_size; ++i) {
+        AVOLT_PROBE_ENTRY(set_vol, writes[i].elem, hardware,
+                probe_hw_vol(writes[i].elem), writes[i].hw_vol);
+        int err = snd_mixer_selem_set_playback_volume(writes[i].elem,
+                writes[i].channel, writes[i].hw_vol);
+        AVOLT_PROBE_RETURN(set_vol, writes[i].elem, hardware,
+                -1, probe_hw_vol(writes[i].elem), err);
+        if (err != 0) {
+            fprintf(stderr, "avolt ERROR: snd mixer set playback volume failed for element '%s'.\n",
+                    snd_mixer_selem_get_name(writes[i].elem));
+        }
+    }
 }
 
 
@@ -155,32 +371,43 @@ void change_range(
 }
 
 
-/* Checks semaphore preventing swamping alsa with multiple avolt instances */
-bool check_semaphore(sem_t** sem)
+/* Opens the semaphore preventing swamping alsa with multiple avolt
+ * instances. It is kept open for the lifetime of the caller, see
+ * wait_semaphore and post_semaphore.
+ * Returns NULL on failure. */
+sem_t* open_semaphore(void)
 {
-    if (!*sem) {
-        /* Note: the final permission depend on the umask (open(2)) */
-        *sem = sem_open("avolt", O_CREAT, 0660, 1);
-        if (*sem == SEM_FAILED) {
-            fprintf(stderr, "Avolt ERROR: Semaphore opening failed.\n");
-            fprintf(stderr, "%s\n", strerror(errno));
-            return false;
-        }
-        if (sem_wait(*sem) == -1) {
-            fprintf(stderr, "Avolt ERROR: Semaphore waiting (decrementing) failed.\n");
-            fprintf(stderr, "%s\n", strerror(errno));
-            return false;
-        }
+    /* Note: the final permission depend on the umask (open(2)) */
+    sem_t* sem = sem_open("avolt", O_CREAT, 0660, 1);
+    if (sem == SEM_FAILED) {
+        fprintf(stderr, "Avolt ERROR: Semaphore opening failed.\n");
+        fprintf(stderr, "%s\n", strerror(errno));
+        return NULL;
     }
-    else {
-        if (sem_post(*sem) == -1) {
-            fprintf(stderr, "Avolt ERROR: Semaphore posting (incrementing) failed.\n");
-            fprintf(stderr, "%s\n", strerror(errno));
-            return false;
-        }
-        sem_close(*sem);
+    return sem;
+}
+
+
+/* Takes the semaphore, does nothing if sem is NULL */
+bool wait_semaphore(sem_t* sem)
+{
+    if (sem && sem_wait(sem) == -1) {
+        fprintf(stderr, "Avolt ERROR: Semaphore waiting (decrementing) failed.\n");
+        fprintf(stderr, "%s\n", strerror(errno));
+        return false;
     }
+    return true;
+}
+
 
+/* Releases the semaphore, does nothing if sem is NULL */
+bool post_semaphore(sem_t* sem)
+{
+    if (sem && sem_post(sem) == -1) {
+        fprintf(stderr, "Avolt ERROR: Semaphore posting (incrementing) failed.\n");
+        fprintf(stderr, "%s\n", strerror(errno));
+        return false;
+    }
     return true;
 }
 
@@ -194,6 +421,8 @@ void toggle_volume(
         enum Volume_type volume_type)
 {
     // TODO: USE "avolt" SEMAPHORE
+    AVOLT_PROBE_ENTRY(toggle_volume, sp->volume_cntrl_mixer_element, volume_type,
+            probe_hw_vol(sp->volume_cntrl_mixer_element), new_vol);
 
     long int current_vol;
     get_vol(sp->volume_cntrl_mixer_element, hardware, &current_vol);
@@ -203,26 +432,29 @@ void toggle_volume(
     // If current volume is lowest possible
     if (current_vol == min) {
         if (new_vol > 0 && new_vol != INT_MAX)
-            set_vol(sp->volume_cntrl_mixer_element, volume_type, new_vol, 0);
+            set_profile_vol(sp, volume_type, new_vol, 0);
         else
-            set_vol(sp->volume_cntrl_mixer_element, sp->volume_type, sp->default_volume, 0);
+            set_profile_vol(sp, sp->volume_type, sp->default_volume, 0);
     }
     else {
         // Else zero current volume
-        set_vol(sp->volume_cntrl_mixer_element, hardware_percentage, 0, 0);
+        set_profile_vol(sp, hardware_percentage, 0, 0);
     }
+    AVOLT_PROBE_RETURN(toggle_volume, sp->volume_cntrl_mixer_element, volume_type,
+            current_vol, probe_hw_vol(sp->volume_cntrl_mixer_element), 0);
     return;
 }
 
 
-/* Sets new volume, expects new_vol to be within [0,100] range. */
+/* Sets new volume, expects new_vol to be within [0,100] range. The change
+ * is made holding sem (see open_semaphore) unless it is NULL. */
 bool set_new_volume(
         struct sound_profile* sp,
         long int new_vol,
         bool relative_inc,
         bool set_default_vol,
         bool toggle_vol,
-        bool use_semaphore,
+        sem_t* sem,
         enum Volume_type volume_type)
 {
     /* XXX: Checking new_vol limits */
@@ -237,8 +469,7 @@ bool set_new_volume(
     }
     /* **************************** */
 
-    sem_t *sem = NULL; /* Semaphore which is used if USE_SEMAPHORE is true */
-    if (use_semaphore && !check_semaphore(&sem)) return false;
+    if (!wait_semaphore(sem)) return false;
 
     /* Change new volume to native range */
     PD_M("set_new_volume: new vol [-100,100], relative or toggling: %li\n", new_vol);
@@ -246,7 +477,7 @@ bool set_new_volume(
     if (set_default_vol) {
         // Set default volume
         PD_M("set_new_volume: setting default vol..\n");
-        set_vol(sp->volume_cntrl_mixer_element, sp->volume_type, sp->default_volume, 0);
+        set_profile_vol(sp, sp->volume_type, sp->default_volume, 0);
     } else if (toggle_vol) {
         // toggle volume
         PD_M("set_new_volume: toggling..\n");
@@ -264,16 +495,15 @@ bool set_new_volume(
                 // By setting the round direction we always guarantee that
                 // some change happens.
                 int round_direction = new_vol < 0 ? -1 : 1;
-                set_vol(sp->volume_cntrl_mixer_element, volume_type, current_vol + new_vol, round_direction);
+                set_profile_vol(sp, volume_type, current_vol + new_vol, round_direction);
             }
         } else {
             // Change absolute volume
             PD_M("set_new_volume: Changing absolute volume: %li\n", new_vol);
-            set_vol(sp->volume_cntrl_mixer_element, volume_type, new_vol, 0);
+            set_profile_vol(sp, volume_type, new_vol, 0);
         }
     }
 
-    if (use_semaphore && !check_semaphore(&sem)) return false;
-    return true;
+    return post_semaphore(sem);
 }
 
@@ -11,13 +11,20 @@ void get_vol(
         enum Volume_type volume_type,
         long int* vol);
 
+int to_hw_vol(
+        snd_mixer_elem_t* elem,
+        enum Volume_type volume_type,
+        long int vol,
+        int round_direction,
+        long int* hw_vol);
+
 bool set_new_volume(
         struct sound_profile* sp,
         long int new_vol,
         bool relative_inc,
         bool set_default_vol,
         bool toggle_vol,
-        bool use_semaphore,
+        sem_t* sem,
         enum Volume_type volume_type);
 
 void change_range(
@@ -28,6 +35,10 @@ void change_range(
         int const r_t_max,
         bool relative);
 
-bool check_semaphore(sem_t** sem);
+sem_t* open_semaphore(void);
+
+bool wait_semaphore(sem_t* sem);
+
+bool post_semaphore(sem_t* sem);
 
 #endif
@@ -36,6 +36,7 @@
 #include <math.h>
 #include <stdbool.h>
 #include "volume_mapping.h"
+#include "mixer_trace.h"
 
 #ifdef __UCLIBC__
 /* 10^x = 10^(log e^x) = (e^x)^log10 = e^(x * log 10) */
@@ -85,6 +86,14 @@ static int (* const set_raw[2])(snd_mixer_elem_t *, snd_mixer_selem_channel_id_t
 	snd_mixer_selem_set_playback_volume,
 	snd_mixer_selem_set_capture_volume,
 };
+static int (* const ask_dB_vol[2])(snd_mixer_elem_t *, long, int, long *) = {
+	snd_mixer_selem_ask_playback_dB_vol,
+	snd_mixer_selem_ask_capture_dB_vol,
+};
+static int (* const ask_vol_dB[2])(snd_mixer_elem_t *, long, long *) = {
+	snd_mixer_selem_ask_playback_vol_dB,
+	snd_mixer_selem_ask_capture_vol_dB,
+};
 
 static double get_normalized_volume(snd_mixer_elem_t *elem,
 				    snd_mixer_selem_channel_id_t channel,
@@ -123,6 +132,50 @@ static double get_normalized_volume(snd_mixer_elem_t *elem,
 	return normalized;
 }
 
+/*
+ * Like get_normalized_volume(), but for the given raw register value instead
+ * of the current volume of a channel.
+ */
+static int get_raw_normalized_volume(snd_mixer_elem_t *elem,
+				     long value,
+				     enum ctl_dir ctl_dir,
+				     double *volume)
+{
+	long min, max, dB;
+	double min_norm;
+	int err;
+
+	err = get_dB_range[ctl_dir](elem, &min, &max);
+	if (err < 0 || min >= max) {
+		err = get_raw_range[ctl_dir](elem, &min, &max);
+		if (err < 0)
+			return err;
+		if (min == max) {
+			*volume = 0;
+			return 0;
+		}
+
+		*volume = (value - min) / (double)(max - min);
+		return 0;
+	}
+
+	err = ask_vol_dB[ctl_dir](elem, value, &dB);
+	if (err < 0)
+		return err;
+
+	if (use_linear_dB_scale(min, max)) {
+		*volume = (dB - min) / (double)(max - min);
+		return 0;
+	}
+
+	*volume = exp10((dB - max) / 6000.0);
+	if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
+		min_norm = exp10((min - max) / 6000.0);
+		*volume = (*volume - min_norm) / (1 - min_norm);
+	}
+	return 0;
+}
+
 static int set_normalized_volume(snd_mixer_elem_t *elem,
 				 snd_mixer_selem_channel_id_t channel,
 				 double volume,
@@ -156,6 +209,45 @@ static int set_normalized_volume(snd_mixer_elem_t *elem,
 	return set_dB[ctl_dir](elem, channel, value, dir);
 }
 
+/*
+ * Like set_normalized_volume(), but only computes the raw register value the
+ * volume would be set to.
+ */
+static int get_normalized_raw_volume(snd_mixer_elem_t *elem,
+				     double volume,
+				     int dir,
+				     enum ctl_dir ctl_dir,
+				     long *value)
+{
+	long min, max;
+	double min_norm;
+	int err;
+
+	err = get_dB_range[ctl_dir](elem, &min, &max);
+	if (err < 0 || min >= max) {
+		err = get_raw_range[ctl_dir](elem, &min, &max);
+		if (err < 0)
+			return err;
+
+		*value = lrint_dir(volume * (max - min), dir) + min;
+		return 0;
+	}
+
+	if (use_linear_dB_scale(min, max))
+		return ask_dB_vol[ctl_dir](elem, lrint_dir(volume * (max - min), dir) + min,
+					   dir, value);
+
+	if (volume <= 0)
+		return ask_dB_vol[ctl_dir](elem, min, dir, value);
+
+	if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
+		min_norm = exp10((min - max) / 6000.0);
+		volume = volume * (1 - min_norm) + min_norm;
+	}
+	return ask_dB_vol[ctl_dir](elem, lrint_dir(6000.0 * log10(volume), dir) + max,
+				   dir, value);
+}
+
 double get_normalized_playback_volume(snd_mixer_elem_t *elem,
 				      snd_mixer_selem_channel_id_t channel)
 {
@@ -183,3 +275,18 @@ int set_normalized_capture_volume(snd_mixer_elem_t *elem,
 {
 	return set_normalized_volume(elem, channel, volume, dir, CAPTURE);
 }
+
+int get_normalized_playback_raw_volume(snd_mixer_elem_t *elem,
+				       double volume,
+				       int dir,
+				       long *value)
+{
+	return get_normalized_raw_volume(elem, volume, dir, PLAYBACK, value);
+}
+
+int get_raw_normalized_playback_volume(snd_mixer_elem_t *elem,
+				       long value,
+				       double *volume)
+{
+	return get_raw_normalized_volume(elem, value, PLAYBACK, volume);
+}
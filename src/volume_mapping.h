@@ -15,5 +15,12 @@ int set_normalized_capture_volume(snd_mixer_elem_t *elem,
 				  snd_mixer_selem_channel_id_t channel,
 				  double volume,
 				  int dir);
+int get_normalized_playback_raw_volume(snd_mixer_elem_t *elem,
+				       double volume,
+				       int dir,
+				       long *value);
+int get_raw_normalized_playback_volume(snd_mixer_elem_t *elem,
+				       long value,
+				       double *volume);
 
 #endif
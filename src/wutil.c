@@ -1,6 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <sys/stat.h>
 
 //void pd(int priority, const char *fmt, ...)
 void pd(const char *fmt, ...)
@@ -13,10 +18,63 @@ void pd(const char *fmt, ...)
     va_end(args);
 }
 
-int nsleep(int nanoseconds) {
-    // TODO: now only works for times under a second
+int nsleep(long int nanoseconds) {
     struct timespec sleeptime;
-    sleeptime.tv_sec = 0;
-    sleeptime.tv_nsec = nanoseconds;
+    sleeptime.tv_sec = nanoseconds / 1000000000L;
+    sleeptime.tv_nsec = nanoseconds % 1000000000L;
     return nanosleep(&sleeptime, NULL);
 }
+
+/* Microseconds from an arbitrary fixed point, not affected by clock changes */
+long long monotonic_usec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+long long monotonic_nsec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Gets path of a per user file to the given buffer, the file named name is
+ * put under directory named by environment variable xdg_env (for example
+ * XDG_CACHE_HOME), or under $HOME/home_fallback if it is not set. Missing
+ * directories under the base directory are created.
+ * Returns false if no directory could be used. */
+bool get_user_file_path(
+        char const* xdg_env,
+        char const* home_fallback,
+        char const* subdir,
+        char const* name,
+        char* path,
+        size_t size)
+{
+    char const* base = getenv(xdg_env);
+    char const* home = getenv("HOME");
+    int len;
+
+    if (base && base[0])
+        len = snprintf(path, size, "%s/%s", base, subdir);
+    else if (home && home[0])
+        len = snprintf(path, size, "%s/%s/%s", home, home_fallback, subdir);
+    else
+        return false;
+    if (len < 0 || (size_t)len >= size) return false;
+
+    /* Create the directories one component at a time */
+    char* sep = strchr(path + 1, '/');
+    for (;; sep = strchr(sep + 1, '/')) {
+        if (sep) *sep = '\0';
+        bool ok = mkdir(path, 0700) == 0 || errno == EEXIST;
+        if (sep) *sep = '/';
+        if (!ok) return false;
+        if (!sep) break;
+    }
+
+    int const name_len = snprintf(path + len, size - len, "/%s", name);
+    return name_len >= 0 && (size_t)name_len < size - len;
+}
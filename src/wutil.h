@@ -1,5 +1,7 @@
 #ifndef WUTIL_H_INCLUDED
 #define WUTIL_H_INCLUDED
+#include <stdbool.h>
+#include <stddef.h>
 // Header file for random c utility functions
 
 // Enable debug printing
@@ -15,6 +17,21 @@
 void pd(const char *fmt, ...);
 
 // Nanosecond sleeper
-int nsleep(int nanoseconds);
+int nsleep(long int nanoseconds);
+
+// Monotonic clock in microseconds
+long long monotonic_usec(void);
+
+// Monotonic clock in nanoseconds
+long long monotonic_nsec(void);
+
+// Per user file path under XDG base directory
+bool get_user_file_path(
+        char const* xdg_env,
+        char const* home_fallback,
+        char const* subdir,
+        char const* name,
+        char* path,
+        size_t size);
 
 #endif
@@ -0,0 +1,441 @@
+/* avolt-replay: Replays a recorded mixer trace against an emulated card.
+ *
+ * Usage: avolt-replay <trace> [<replay trace>]
+ *
+ * The emulated card is seeded from the trace: elements, their capabilities,
+ * ranges, the volume and switch values first read and the mean latency of
+ * each operation. avolt is then run in a child process with the recorded
+ * command line against the emulated card, recording a new trace. The call
+ * sequences of the traces are compared, leaving out event handling and poll
+ * descriptor calls whose count depends on timing, and per operation timings
+ * are printed.
+ *
+ * Exit status is 0 if the sequences match, 1 if they diverge and 2 on
+ * errors.
+ */
+#define MIXER_TRACE_NO_REDIRECT
+#include <alsa/asoundlib.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "emu_mixer.h"
+#include "mixer_trace.h"
+#include "tool_util.h"
+
+
+#define MAX_ARGS 64
+#define MAX_DIVERGENCES 10
+
+
+int avolt_main(const int argc, const char* argv[]);
+
+
+struct trace
+{
+    struct trace_header header;
+    struct trace_record* records;
+    size_t size;
+    char names[EMU_MAX_ELEMS][TRACE_NAME_SIZE];
+};
+
+
+static bool read_trace(char const* path, struct trace* t)
+{
+    memset(t, 0, sizeof(*t));
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "avolt-replay ERROR: Could not open '%s'.\n", path);
+        return false;
+    }
+    if (fread(&t->header, sizeof(t->header), 1, f) != 1 ||
+            memcmp(t->header.magic, TRACE_MAGIC, sizeof(t->header.magic)) != 0 ||
+            t->header.version != TRACE_VERSION ||
+            t->header.record_size != sizeof(struct trace_record) ||
+            t->header.args_size > TRACE_ARGS_SIZE) {
+        fprintf(stderr, "avolt-replay ERROR: '%s' is not a valid trace.\n", path);
+        fclose(f);
+        return false;
+    }
+
+    size_t capacity = 0;
+    struct trace_record rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (t->size == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            struct trace_record* r = realloc(t->records, capacity * sizeof(rec));
+            if (!r) {
+                fclose(f);
+                return false;
+            }
+            t->records = r;
+        }
+        if (rec.op == trace_elem_name && rec.elem < EMU_MAX_ELEMS) {
+            memcpy(t->names[rec.elem], rec.u.name, TRACE_NAME_SIZE);
+            t->names[rec.elem][TRACE_NAME_SIZE - 1] = '\0';
+        }
+        t->records[t->size++] = rec;
+    }
+    fclose(f);
+    return true;
+}
+
+
+static char const* elem_name(struct trace const* t, uint16_t elem)
+{
+    return elem < EMU_MAX_ELEMS ? t->names[elem] : "-";
+}
+
+
+/* Sets up the emulated card from the recorded calls. Capabilities and
+ * channels come from the recorded queries and from which calls succeeded,
+ * values from the first reads before any writes. */
+static void seed_card(struct trace const* t)
+{
+    struct emu_elem_config* elems[EMU_MAX_ELEMS] = { NULL };
+    /* Per direction, index 1 for capture */
+    uint32_t volume_seen[2][EMU_MAX_ELEMS] = { { 0 } };
+    uint32_t switch_seen[2][EMU_MAX_ELEMS] = { { 0 } };
+    uint32_t dB_read[2][EMU_MAX_ELEMS] = { { 0 } };
+    bool range_read[EMU_MAX_ELEMS] = { false };
+    static long read_dBs[2][EMU_MAX_ELEMS][SND_MIXER_SCHN_LAST + 1];
+    long long duration_sum[trace_op_count] = { 0 };
+    long count[trace_op_count] = { 0 };
+
+    emu_reset();
+    for (size_t i = 0; i < t->size; ++i) {
+        struct trace_record const* r = &t->records[i];
+        if (r->op == trace_elem_name) {
+            if (r->elem >= EMU_MAX_ELEMS) continue;
+            struct emu_elem_config* c = emu_add_elem(t->names[r->elem]);
+            if (!c) continue;
+            c->playback_channels = 0;
+            c->has_playback_volume = false;
+            c->has_playback_switch = false;
+            elems[r->elem] = c;
+            continue;
+        }
+        if (r->op >= trace_op_count) continue;
+        duration_sum[r->op] += r->duration_ns;
+        ++count[r->op];
+
+        struct emu_elem_config* c = r->elem < EMU_MAX_ELEMS ? elems[r->elem] : NULL;
+        if (!c) continue;
+        int const ch = r->channel;
+        uint32_t const channel = ch >= 0 && ch <= SND_MIXER_SCHN_LAST ? 1u << ch : 0;
+        bool const ok = r->ret == 0;
+        int const capture = r->op > trace_op_snd_mixer_selem_ask_playback_vol_dB;
+        long* const volumes = capture ? c->capture_volumes : c->volumes;
+        uint32_t* const switches = capture ? &c->capture_switches : &c->switches;
+        switch (r->op) {
+            case trace_op_snd_mixer_selem_has_playback_volume:
+                c->has_playback_volume |= r->ret; break;
+            case trace_op_snd_mixer_selem_has_playback_switch:
+                c->has_playback_switch |= r->ret; break;
+            case trace_op_snd_mixer_selem_has_capture_volume:
+                c->has_capture_volume |= r->ret; break;
+            case trace_op_snd_mixer_selem_has_capture_switch:
+                c->has_capture_switch |= r->ret; break;
+            case trace_op_snd_mixer_selem_has_playback_channel:
+                if (r->ret) c->playback_channels |= channel;
+                break;
+            case trace_op_snd_mixer_selem_has_capture_channel:
+                if (r->ret) c->capture_channels |= channel;
+                break;
+            case trace_op_snd_mixer_selem_get_playback_volume_range:
+            case trace_op_snd_mixer_selem_get_capture_volume_range:
+                if (ok) {
+                    c->min = r->u.call.out[0];
+                    c->max = r->u.call.out[1];
+                    range_read[r->elem] = true;
+                }
+                break;
+            case trace_op_snd_mixer_selem_get_playback_dB_range:
+            case trace_op_snd_mixer_selem_get_capture_dB_range:
+                if (ok) {
+                    c->has_dB = true;
+                    c->dB_min = r->u.call.out[0];
+                    c->dB_max = r->u.call.out[1];
+                }
+                break;
+            case trace_op_snd_mixer_selem_get_playback_volume:
+            case trace_op_snd_mixer_selem_get_playback_dB:
+            case trace_op_snd_mixer_selem_get_capture_volume:
+            case trace_op_snd_mixer_selem_get_capture_dB:
+                if (!ok) break;
+                if (!(volume_seen[capture][r->elem] & channel)) {
+                    bool const dB =
+                        r->op == trace_op_snd_mixer_selem_get_playback_dB ||
+                        r->op == trace_op_snd_mixer_selem_get_capture_dB;
+                    if (dB) {
+                        read_dBs[capture][r->elem][ch] = r->u.call.out[0];
+                        dB_read[capture][r->elem] |= channel;
+                    } else {
+                        volumes[ch] = r->u.call.out[0];
+                    }
+                }
+                volume_seen[capture][r->elem] |= channel;
+                /* fall through */
+            case trace_op_snd_mixer_selem_set_playback_volume:
+            case trace_op_snd_mixer_selem_set_playback_dB:
+            case trace_op_snd_mixer_selem_set_capture_volume:
+            case trace_op_snd_mixer_selem_set_capture_dB:
+                if (!ok) break;
+                volume_seen[capture][r->elem] |= channel;
+                if (!capture) {
+                    c->has_playback_volume = true;
+                    c->playback_channels |= channel;
+                } else {
+                    c->has_capture_volume = true;
+                    c->capture_channels |= channel;
+                }
+                break;
+            case trace_op_snd_mixer_selem_get_playback_switch:
+            case trace_op_snd_mixer_selem_get_capture_switch:
+                if (!ok) break;
+                if (!(switch_seen[capture][r->elem] & channel) && r->u.call.out[0])
+                    *switches |= channel;
+                /* fall through */
+            case trace_op_snd_mixer_selem_set_playback_switch:
+            case trace_op_snd_mixer_selem_set_capture_switch:
+                if (!ok) break;
+                switch_seen[capture][r->elem] |= channel;
+                if (!capture) {
+                    c->has_playback_switch = true;
+                    c->playback_channels |= channel;
+                } else {
+                    c->has_capture_switch = true;
+                    c->capture_channels |= channel;
+                }
+                break;
+            case trace_op_snd_mixer_selem_set_playback_volume_all:
+            case trace_op_snd_mixer_selem_set_playback_dB_all:
+                if (ok) c->has_playback_volume = true;
+                volume_seen[0][r->elem] = ~0u;
+                break;
+            case trace_op_snd_mixer_selem_set_capture_volume_all:
+                if (ok) c->has_capture_volume = true;
+                volume_seen[1][r->elem] = ~0u;
+                break;
+            case trace_op_snd_mixer_selem_set_playback_switch_all:
+                if (ok) c->has_playback_switch = true;
+                switch_seen[0][r->elem] = ~0u;
+                break;
+            case trace_op_snd_mixer_selem_set_capture_switch_all:
+                if (ok) c->has_capture_switch = true;
+                switch_seen[1][r->elem] = ~0u;
+                break;
+            default:
+                break;
+        }
+    }
+
+    /* Values read only in dB are mapped back like the emulated card does.
+     * Without a recorded hardware range one step is made 0.01 dB, so that
+     * the recorded dB values are reproduced exactly. */
+    for (int e = 0; e < EMU_MAX_ELEMS; ++e) {
+        struct emu_elem_config* c = elems[e];
+        if (!c || !c->has_dB || c->dB_max == c->dB_min) continue;
+        if (!range_read[e]) {
+            c->min = 0;
+            c->max = c->dB_max - c->dB_min;
+        }
+        for (int d = 0; d < 2; ++d) {
+            long* const volumes = d ? c->capture_volumes : c->volumes;
+            for (int ch = 0; ch <= SND_MIXER_SCHN_LAST; ++ch) {
+                if (!(dB_read[d][e] & (1u << ch))) continue;
+                volumes[ch] = c->min + lrint((double)(read_dBs[d][e][ch] - c->dB_min) *
+                        (c->max - c->min) / (c->dB_max - c->dB_min));
+            }
+        }
+    }
+
+    for (int op = 0; op < trace_op_count; ++op) {
+        if (count[op]) emu_set_latency(op, duration_sum[op] / count[op]);
+    }
+}
+
+
+/* Runs avolt with the recorded arguments against the emulated card,
+ * recording to replay_path. Returns exit status of the run. */
+static int run_avolt(struct trace const* t, char const* replay_path)
+{
+    char args[TRACE_ARGS_SIZE];
+    char const* argv[MAX_ARGS + 4];
+    int argc = 0;
+
+    memcpy(args, t->header.args, TRACE_ARGS_SIZE);
+    argv[argc++] = "avolt";
+    for (uint32_t i = 0; i < t->header.args_size && argc < MAX_ARGS;
+            i += strlen(args + i) + 1) {
+        argv[argc++] = args + i;
+    }
+    argv[argc++] = "--record";
+    argv[argc++] = replay_path;
+    argv[argc] = NULL;
+
+    pid_t const pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        /* Questions get the default answer */
+        int const fd = open("/dev/null", O_RDONLY);
+        if (fd >= 0) dup2(fd, STDIN_FILENO);
+        exit(avolt_main(argc, argv));
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "avolt-replay: avolt killed by signal %d.\n",
+                WTERMSIG(status));
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+
+/* Calls compared between traces */
+static bool is_compared(struct trace_record const* r)
+{
+    switch (r->op) {
+        case trace_elem_name:
+        case trace_op_snd_mixer_handle_events:
+        case trace_op_snd_mixer_poll_descriptors_count:
+        case trace_op_snd_mixer_poll_descriptors:
+        case trace_op_snd_mixer_poll_descriptors_revents:
+            return false;
+        default:
+            return r->op < trace_op_count;
+    }
+}
+
+
+static bool records_match(
+        struct trace const* a, struct trace_record const* ra,
+        struct trace const* b, struct trace_record const* rb)
+{
+    return ra->op == rb->op &&
+        strcmp(elem_name(a, ra->elem), elem_name(b, rb->elem)) == 0 &&
+        ra->channel == rb->channel &&
+        ra->ret == rb->ret &&
+        memcmp(&ra->u.call, &rb->u.call, sizeof(ra->u.call)) == 0;
+}
+
+
+static void print_record(char const* prefix, struct trace const* t,
+        struct trace_record const* r)
+{
+    if (!r) {
+        printf("  %s <end of trace>\n", prefix);
+        return;
+    }
+    printf("  %s %s(%s, ch %d, in %lld %lld) = %d, out %lld %lld\n", prefix,
+            trace_op_name(r->op), elem_name(t, r->elem), r->channel,
+            (long long)r->u.call.in[0], (long long)r->u.call.in[1], r->ret,
+            (long long)r->u.call.out[0], (long long)r->u.call.out[1]);
+}
+
+
+/* Compares call sequences, returns number of divergences found */
+static int compare_traces(struct trace const* a, struct trace const* b)
+{
+    int divergences = 0;
+    size_t ia = 0, ib = 0, call = 0;
+    while (true) {
+        while (ia < a->size && !is_compared(&a->records[ia])) ++ia;
+        while (ib < b->size && !is_compared(&b->records[ib])) ++ib;
+        if (ia == a->size && ib == b->size) break;
+
+        struct trace_record const* ra = ia < a->size ? &a->records[ia] : NULL;
+        struct trace_record const* rb = ib < b->size ? &b->records[ib] : NULL;
+        if (!ra || !rb || !records_match(a, ra, b, rb)) {
+            if (++divergences <= MAX_DIVERGENCES) {
+                printf("Divergence at call %zu:\n", call);
+                print_record("recorded:", a, ra);
+                print_record("replayed:", b, rb);
+            }
+            /* Sequences are out of sync after a missing call */
+            if (!ra || !rb || ra->op != rb->op) break;
+        }
+        ++ia;
+        ++ib;
+        ++call;
+    }
+    return divergences;
+}
+
+
+static void print_timings(struct trace const* a, struct trace const* b)
+{
+    long long sum_a[trace_op_count] = { 0 }, sum_b[trace_op_count] = { 0 };
+    long count_a[trace_op_count] = { 0 }, count_b[trace_op_count] = { 0 };
+
+    for (size_t i = 0; i < a->size; ++i) {
+        if (a->records[i].op >= trace_op_count) continue;
+        sum_a[a->records[i].op] += a->records[i].duration_ns;
+        ++count_a[a->records[i].op];
+    }
+    for (size_t i = 0; i < b->size; ++i) {
+        if (b->records[i].op >= trace_op_count) continue;
+        sum_b[b->records[i].op] += b->records[i].duration_ns;
+        ++count_b[b->records[i].op];
+    }
+
+    printf("%-42s %8s %12s %8s %12s\n", "operation",
+            "calls", "recorded ns", "calls", "replayed ns");
+    for (int op = trace_elem_name + 1; op < trace_op_count; ++op) {
+        if (!count_a[op] && !count_b[op]) continue;
+        printf("%-42s %8ld %12lld %8ld %12lld\n", trace_op_name(op),
+                count_a[op], count_a[op] ? sum_a[op] / count_a[op] : 0,
+                count_b[op], count_b[op] ? sum_b[op] / count_b[op] : 0);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <trace> [<replay trace>]\n", argv[0]);
+        return 2;
+    }
+
+    /* Keep the replay away from user's settle times and snapshots */
+    char tmp_dir[] = "/tmp/avolt-replay-XXXXXX";
+    if (!mkdtemp(tmp_dir)) {
+        perror("avolt-replay ERROR: mkdtemp");
+        return 2;
+    }
+    setenv("XDG_CACHE_HOME", tmp_dir, 1);
+    setenv("XDG_DATA_HOME", tmp_dir, 1);
+
+    char replay_path[sizeof(tmp_dir) + 16];
+    snprintf(replay_path, sizeof(replay_path), "%s/replay.trace", tmp_dir);
+
+    int rc = 2;
+    struct trace a, b;
+    memset(&b, 0, sizeof(b));
+    if (read_trace(argv[1], &a)) {
+        seed_card(&a);
+        int const status = run_avolt(&a, argc == 3 ? argv[2] : replay_path);
+        if (status >= 0 && read_trace(argc == 3 ? argv[2] : replay_path, &b)) {
+            printf("avolt exited with %d, %zu recorded and %zu replayed records.\n",
+                    status, a.size, b.size);
+            int const divergences = compare_traces(&a, &b);
+            print_timings(&a, &b);
+            if (divergences) printf("%d divergences.\n", divergences);
+            else printf("Call sequences match.\n");
+            rc = divergences ? 1 : 0;
+        }
+    }
+
+    free(a.records);
+    free(b.records);
+    remove_tree(tmp_dir);
+    return rc;
+}
@@ -0,0 +1,515 @@
+/* avolt-topology: Runs profile resolution over generated card layouts and
+ * profile sets against the emulated card.
+ *
+ * Usage: avolt-topology [<configs> [<seed> [<workers>]]]
+ *        avolt-topology --show <config> [<seed>]
+ *
+ * Each configuration is generated from the seed and its index: a card with
+ * elements with and without volumes and switches, some or none of them
+ * switched on, and profiles on them with shared volume control elements,
+ * missing elements, mixed volume types and a toggle ring of random size and
+ * order. Profile counts cycle through PROFILE_COUNTS.
+ *
+ * Every configuration runs in its own forked worker, up to one per core at a
+ * time. A worker opens a context with the configuration, times resolution of
+ * the current and target profiles, and then toggles around the ring and
+ * switches to every profile. Resolution times are reported per profile count,
+ * and every configuration whose worker was killed by a signal, like a failed
+ * assert, or exited with an error is listed. --show prints one configuration and runs it in the
+ * foreground.
+ *
+ * Exit status is 0 if no worker failed, 1 if some did and 2 on errors.
+ */
+#define MIXER_TRACE_NO_REDIRECT
+#include <alsa/asoundlib.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "emu_mixer.h"
+#include "libavolt.h"
+#include "tool_util.h"
+#include "wutil.h"
+
+
+#define TOPO_MAX_ELEMS 64
+#define TOPO_MAX_PROFILES 128
+#define TOPO_NAME_SIZE 16
+#define RESOLVE_ROUNDS 64
+#define WORKER_TIMEOUT_S 10
+#define MAX_SHOWN_FAILURES 200
+
+static int const PROFILE_COUNTS[] = { 1, 2, 3, 4, 8, 16, 32, 64, 128 };
+#define PROFILE_COUNTS_SIZE ((int)(sizeof(PROFILE_COUNTS) / sizeof(PROFILE_COUNTS[0])))
+
+static long const ELEM_MAXES[] = { 1, 31, 63, 87, 100, 255 };
+
+
+/* Generated card and profile set */
+struct topology
+{
+    int elems_size;
+    struct emu_elem_config elems[TOPO_MAX_ELEMS];
+
+    int profiles_size;
+    struct sound_profile profiles[TOPO_MAX_PROFILES];
+    char profile_names[TOPO_MAX_PROFILES][TOPO_NAME_SIZE];
+    char elem_names[TOPO_MAX_PROFILES][2][TOPO_NAME_SIZE];
+
+    int toggle_size;
+    int toggle[TOPO_MAX_PROFILES];
+
+    enum Volume_type volume_type;
+    enum Soft_limit_policy soft_limit_policy;
+};
+
+
+/* Result of a worker, in memory shared with the parent */
+struct worker_result
+{
+    bool done;                  // Worker finished without being killed.
+    bool opened;                // Some profile could be initialized.
+    int init_ok;                // Initialized profiles.
+    long long open_ns;
+    long long resolve_ns;       // Mean of one current and target resolution.
+    int ops;                    // Toggles and profile switches done.
+    int failed_ops;             // Of which returned false.
+};
+
+
+static uint64_t next_random(uint64_t* state)
+{
+    /* xorshift64* */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+
+static int random_below(uint64_t* state, int n)
+{
+    return n > 0 ? (int)(next_random(state) % (uint64_t)n) : 0;
+}
+
+
+static bool random_chance(uint64_t* state, int percent)
+{
+    return random_below(state, 100) < percent;
+}
+
+
+/* Random volume of the given type for profile defaults and limits */
+static int random_volume(uint64_t* state, enum Volume_type type)
+{
+    switch (type) {
+        case hardware: return random_below(state, 256);
+        case decibels: return -random_below(state, 60);
+        default: return random_below(state, 101);
+    }
+}
+
+
+/* Element name of a profile, an element of the card or a missing one */
+static char* pick_elem(
+        struct topology* t,
+        uint64_t* state,
+        char* name)
+{
+    if (random_chance(state, 5))
+        snprintf(name, TOPO_NAME_SIZE, "Missing %d", random_below(state, 4));
+    else
+        strcpy(name, t->elems[random_below(state, t->elems_size)].name);
+    return name;
+}
+
+
+/* Generates configuration index of the seed */
+static void generate(struct topology* t, uint64_t seed, int index)
+{
+    memset(t, 0, sizeof(*t));
+    uint64_t state = seed ^ (0x9e3779b97f4a7c15ULL * (uint64_t)(index + 1));
+    if (!state) state = 1;
+    for (int i = 0; i < 4; ++i) next_random(&state);
+
+    t->profiles_size = PROFILE_COUNTS[index % PROFILE_COUNTS_SIZE];
+    /* Fewer elements than profiles makes profiles share elements */
+    t->elems_size = 1 + random_below(&state, t->profiles_size < TOPO_MAX_ELEMS ?
+            t->profiles_size + 1 : TOPO_MAX_ELEMS);
+    bool const none_on = random_chance(&state, 10);
+
+    for (int i = 0; i < t->elems_size; ++i) {
+        struct emu_elem_config* c = &t->elems[i];
+        snprintf(c->name, EMU_NAME_SIZE, "Elem %d", i);
+        c->playback_channels = random_chance(&state, 30) ?
+            1u << SND_MIXER_SCHN_FRONT_LEFT :
+            1u << SND_MIXER_SCHN_FRONT_LEFT | 1u << SND_MIXER_SCHN_FRONT_RIGHT;
+        c->has_playback_volume = random_chance(&state, 85);
+        c->has_playback_switch = random_chance(&state, 75);
+        c->min = 0;
+        c->max = ELEM_MAXES[random_below(&state, sizeof(ELEM_MAXES) / sizeof(ELEM_MAXES[0]))];
+        c->has_dB = random_chance(&state, 60);
+        c->dB_min = -100 * (10 + random_below(&state, 80));
+        c->dB_max = 0;
+        for (int ch = 0; ch <= SND_MIXER_SCHN_LAST; ++ch)
+            c->volumes[ch] = random_below(&state, c->max + 1);
+        c->switches = c->has_playback_switch && !none_on && random_chance(&state, 50) ?
+            c->playback_channels : 0;
+    }
+
+    bool const mixed_types = random_chance(&state, 50);
+    t->volume_type = mixed_types ? (enum Volume_type)random_below(&state, 4) : alsa_percentage;
+    t->soft_limit_policy = (enum Soft_limit_policy)random_below(&state, 3);
+
+    for (int i = 0; i < t->profiles_size; ++i) {
+        struct sound_profile* sp = &t->profiles[i];
+        snprintf(t->profile_names[i], TOPO_NAME_SIZE, "profile %d", i);
+        sp->profile_name = t->profile_names[i];
+        sp->mixer_element_name = pick_elem(t, &state, t->elem_names[i][0]);
+        sp->volume_cntrl_mixer_element_name = random_chance(&state, 50) ?
+            pick_elem(t, &state, t->elem_names[i][1]) : NULL;
+        sp->volume_type = mixed_types ?
+            (enum Volume_type)random_below(&state, 4) : alsa_percentage;
+        sp->default_volume = random_volume(&state, sp->volume_type);
+        sp->soft_limit_volume = random_volume(&state, sp->volume_type);
+        sp->set_default_volume = random_chance(&state, 50);
+        sp->confirm_exceeding_volume_limit = random_chance(&state, 30);
+    }
+
+    /* Ring of distinct profiles in random order, possibly empty */
+    int order[TOPO_MAX_PROFILES];
+    for (int i = 0; i < t->profiles_size; ++i) order[i] = i;
+    for (int i = t->profiles_size - 1; i > 0; --i) {
+        int const j = random_below(&state, i + 1);
+        int const tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    t->toggle_size = random_below(&state, t->profiles_size + 1);
+    memcpy(t->toggle, order, t->toggle_size * sizeof(int));
+}
+
+
+/* Builds a configuration owned by the caller like load_default_config */
+static bool build_config(struct topology const* t, struct avolt_config* config)
+{
+    memset(config, 0, sizeof(*config));
+    config->profiles = calloc(t->profiles_size, sizeof(struct sound_profile));
+    config->toggle_profiles = calloc(t->toggle_size > 0 ? t->toggle_size : 1, sizeof(int));
+    if (!config->profiles || !config->toggle_profiles) {
+        free_config(config);
+        return false;
+    }
+    config->profiles_size = t->profiles_size;
+    memcpy(config->profiles, t->profiles, t->profiles_size * sizeof(struct sound_profile));
+    config->toggle_profiles_size = t->toggle_size;
+    memcpy(config->toggle_profiles, t->toggle, t->toggle_size * sizeof(int));
+
+    config->volume_type = t->volume_type;
+    /* A killed worker must not leave the semaphore taken for the others */
+    config->use_semaphore = false;
+    config->settle_timeout_min_ms = 1;
+    config->settle_timeout_max_ms = 5;
+    config->soft_limit_policy = t->soft_limit_policy;
+    config->soft_limit_confirm_timeout_ms = 0;
+    config->stream_frame_ms = 5;
+    return true;
+}
+
+
+/* Runs configuration in the calling process, filling result */
+static void run_config(struct topology const* t, struct worker_result* result)
+{
+    emu_reset();
+    for (int i = 0; i < t->elems_size; ++i) {
+        struct emu_elem_config* c = emu_add_elem(t->elems[i].name);
+        if (c) *c = t->elems[i];
+    }
+
+    struct avolt_config config;
+    if (!build_config(t, &config)) return;
+
+    long long const start = monotonic_nsec();
+    struct avolt_ctx* ctx = avolt_open_config(&config);
+    result->open_ns = monotonic_nsec() - start;
+    if (!ctx) {
+        result->done = true;
+        return;
+    }
+    result->opened = true;
+
+    struct avolt_config const* c = avolt_get_config(ctx);
+    for (int i = 0; i < c->profiles_size; ++i)
+        result->init_ok += c->profiles[i].init_ok;
+
+    long long const resolve_start = monotonic_nsec();
+    for (int i = 0; i < RESOLVE_ROUNDS; ++i) {
+        struct sound_profile* current = get_current_sound_profile(c);
+        get_target_sound_profile(c, current);
+    }
+    result->resolve_ns = (monotonic_nsec() - resolve_start) / RESOLVE_ROUNDS;
+
+    /* Around the ring and once more, then to every profile by name */
+    for (int i = 0; i <= c->toggle_profiles_size; ++i) {
+        result->ops++;
+        if (!avolt_toggle_output(ctx, INT_MAX, false, false, false))
+            result->failed_ops++;
+    }
+    for (int i = 0; i < c->profiles_size; ++i) {
+        result->ops++;
+        if (!avolt_set_profile(ctx, c->profiles[i].profile_name, 50, false, false, false))
+            result->failed_ops++;
+    }
+    long int vol;
+    avolt_get_volume(ctx, &vol);
+
+    avolt_close(ctx);
+    result->done = true;
+}
+
+
+static char const* Volume_type_names[] = { "alsa%", "hw%", "hw", "dB" };
+
+
+/* Prints the configuration in full */
+static void print_topology(struct topology const* t, FILE* output)
+{
+    fprintf(output, "Volume type %s, %i elements, %i profiles, ring of %i\n",
+            Volume_type_names[t->volume_type], t->elems_size, t->profiles_size,
+            t->toggle_size);
+    for (int i = 0; i < t->elems_size; ++i) {
+        struct emu_elem_config const* c = &t->elems[i];
+        fprintf(output, "  %-10s %s volume [0,%li]%s, %s\n", c->name,
+                c->has_playback_volume ? "with" : "no",
+                c->max, c->has_dB ? " dB" : "",
+                !c->has_playback_switch ? "no switch" :
+                c->switches ? "switch on" : "switch off");
+    }
+    for (int i = 0; i < t->profiles_size; ++i) {
+        struct sound_profile const* sp = &t->profiles[i];
+        fprintf(output, "  %-12s %s, volume on %s, %s, default %i, limit %i%s\n",
+                sp->profile_name, sp->mixer_element_name,
+                sp->volume_cntrl_mixer_element_name ?
+                sp->volume_cntrl_mixer_element_name : "same",
+                Volume_type_names[sp->volume_type], sp->default_volume,
+                sp->soft_limit_volume,
+                sp->confirm_exceeding_volume_limit ? " confirmed" : "");
+    }
+    fprintf(output, "  Ring:");
+    for (int i = 0; i < t->toggle_size; ++i)
+        fprintf(output, " %i", t->toggle[i]);
+    fprintf(output, "\n");
+}
+
+
+/* One line summary of the properties which matter for resolution */
+static void print_summary(struct topology const* t, FILE* output)
+{
+    int switched_on = 0, no_switch = 0, missing = 0;
+    bool mixed = false;
+    for (int i = 0; i < t->elems_size; ++i) {
+        if (!t->elems[i].has_playback_switch) no_switch++;
+        else if (t->elems[i].switches) switched_on++;
+    }
+    for (int i = 0; i < t->profiles_size; ++i) {
+        struct sound_profile const* sp = &t->profiles[i];
+        if (strncmp(sp->mixer_element_name, "Missing", 7) == 0) missing++;
+        if (sp->volume_type != t->volume_type) mixed = true;
+    }
+    fprintf(output, "%i profiles on %i elements (%i on, %i without switch), "
+            "%i missing, ring of %i%s", t->profiles_size, t->elems_size,
+            switched_on, no_switch, missing, t->toggle_size,
+            mixed ? ", mixed volume types" : "");
+}
+
+
+/* Forks a worker for configuration index. Returns its pid or -1. */
+static pid_t start_worker(uint64_t seed, int index, struct worker_result* result)
+{
+    pid_t const pid = fork();
+    if (pid != 0) return pid;
+
+    /* Errors of the generated configurations are expected */
+    int const fd = open("/dev/null", O_RDWR);
+    if (fd >= 0) {
+        dup2(fd, STDIN_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+    }
+    alarm(WORKER_TIMEOUT_S);
+
+    struct topology t;
+    generate(&t, seed, index);
+    run_config(&t, result);
+    _exit(0);
+}
+
+
+/* Prints resolution times per profile count */
+static void print_report(struct worker_result const* results, int configs)
+{
+    printf("%9s %8s %8s %8s %12s %12s %12s %10s\n", "profiles", "configs",
+            "opened", "killed", "open us", "resolve ns", "max ns", "ops failed");
+    for (int b = 0; b < PROFILE_COUNTS_SIZE; ++b) {
+        int count = 0, opened = 0, killed = 0;
+        long long open_sum = 0, resolve_sum = 0, resolve_max = 0;
+        long failed_ops = 0, ops = 0;
+        for (int i = b; i < configs; i += PROFILE_COUNTS_SIZE) {
+            struct worker_result const* r = &results[i];
+            count++;
+            if (!r->done) {
+                killed++;
+                continue;
+            }
+            if (!r->opened) continue;
+            opened++;
+            open_sum += r->open_ns;
+            resolve_sum += r->resolve_ns;
+            if (r->resolve_ns > resolve_max) resolve_max = r->resolve_ns;
+            ops += r->ops;
+            failed_ops += r->failed_ops;
+        }
+        if (!count) continue;
+        printf("%9i %8i %8i %8i %12lli %12lli %12lli %9.1f%%\n", PROFILE_COUNTS[b],
+                count, opened, killed,
+                opened ? open_sum / opened / 1000 : 0,
+                opened ? resolve_sum / opened : 0, resolve_max,
+                ops ? 100.0 * failed_ops / ops : 0.0);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool const show = argc > 1 && strcmp(argv[1], "--show") == 0;
+    if ((show && (argc < 3 || argc > 4)) || (!show && argc > 4)) {
+        fprintf(stderr, "Usage: %s [<configs> [<seed> [<workers>]]]\n"
+                "       %s --show <config> [<seed>]\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    int const configs = show ? 0 : argc > 1 ? atoi(argv[1]) : 4 * PROFILE_COUNTS_SIZE * 100;
+    uint64_t const seed = argc > (show ? 3 : 2) ?
+        strtoull(argv[show ? 3 : 2], NULL, 0) : 1;
+    long workers = argc > 3 && !show ? atol(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+
+    /* Keep the runs away from user's settle times */
+    char tmp_dir[] = "/tmp/avolt-topology-XXXXXX";
+    if (!mkdtemp(tmp_dir)) {
+        perror("avolt-topology ERROR: mkdtemp");
+        return 2;
+    }
+    setenv("XDG_CACHE_HOME", tmp_dir, 1);
+    setenv("XDG_DATA_HOME", tmp_dir, 1);
+    setenv("XDG_RUNTIME_DIR", tmp_dir, 1);
+
+    if (show) {
+        struct topology t;
+        generate(&t, seed, atoi(argv[2]));
+        print_topology(&t, stdout);
+        fflush(stdout);
+        struct worker_result result = { .done = false };
+        run_config(&t, &result);
+        printf("Opened: %s, %i of %i operations failed, resolution %lli ns\n",
+                result.opened ? "yes" : "no", result.failed_ops, result.ops,
+                result.resolve_ns);
+        remove_tree(tmp_dir);
+        return 0;
+    }
+    if (configs < 1) {
+        fprintf(stderr, "avolt-topology ERROR: No configurations to run.\n");
+        remove_tree(tmp_dir);
+        return 2;
+    }
+
+    /* Workers write their results to a file mapped before forking */
+    size_t const results_size = configs * sizeof(struct worker_result);
+    char results_path[sizeof(tmp_dir) + 16];
+    snprintf(results_path, sizeof(results_path), "%s/results", tmp_dir);
+    int const results_fd = open(results_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    struct worker_result* results = MAP_FAILED;
+    if (results_fd >= 0 && ftruncate(results_fd, results_size) == 0)
+        results = mmap(NULL, results_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                results_fd, 0);
+    if (results_fd >= 0) close(results_fd);
+    int* statuses = calloc(configs, sizeof(int));
+    pid_t* pids = calloc(configs, sizeof(pid_t));
+    if (results == MAP_FAILED || !statuses || !pids) {
+        fprintf(stderr, "avolt-topology ERROR: Out of memory.\n");
+        remove_tree(tmp_dir);
+        return 2;
+    }
+
+    printf("Running %i configurations with seed %llu in %li workers.\n",
+            configs, (unsigned long long)seed, workers);
+    fflush(stdout);
+    long long const start = monotonic_nsec();
+
+    int next = 0, running = 0, rc = 0;
+    while (next < configs || running > 0) {
+        while (next < configs && running < workers) {
+            pids[next] = start_worker(seed, next, &results[next]);
+            if (pids[next] < 0) {
+                perror("avolt-topology ERROR: fork");
+                rc = 2;
+                break;
+            }
+            ++next;
+            ++running;
+        }
+        if (rc == 2 && running == 0) break;
+
+        int status;
+        pid_t const pid = wait(&status);
+        if (pid < 0) break;
+        --running;
+        /* Only running workers are matched, a reaped pid may be reused */
+        for (int i = 0; i < next; ++i) {
+            if (pids[i] != pid) continue;
+            pids[i] = 0;
+            statuses[i] = status;
+            break;
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            if (rc == 0) rc = 1;
+        }
+    }
+
+    printf("Finished in %lli ms.\n", (monotonic_nsec() - start) / 1000000);
+    print_report(results, configs);
+
+    int failed = 0;
+    for (int i = 0; i < configs; ++i) {
+        int const status = statuses[i];
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+        if (++failed > MAX_SHOWN_FAILURES) continue;
+        struct topology t;
+        generate(&t, seed, i);
+        if (WIFSIGNALED(status))
+            printf("config %i: %s, ", i, strsignal(WTERMSIG(status)));
+        else
+            printf("config %i: exit status %i, ", i, WEXITSTATUS(status));
+        print_summary(&t, stdout);
+        printf("\n");
+    }
+    if (failed > MAX_SHOWN_FAILURES)
+        printf("... and %i more.\n", failed - MAX_SHOWN_FAILURES);
+    printf("%i of %i configurations failed.", failed, configs);
+    if (failed) printf(" Rerun one with --show <config> %llu.", (unsigned long long)seed);
+    printf("\n");
+
+    munmap(results, results_size);
+    free(statuses);
+    free(pids);
+    remove_tree(tmp_dir);
+    return rc;
+}
@@ -0,0 +1,523 @@
+/* Emulated sound card, see emu_mixer.h. */
+#define MIXER_TRACE_NO_REDIRECT
+#include <alsa/asoundlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emu_mixer.h"
+#include "mixer_trace.h"
+
+
+#define EMU_MAX_MIXERS 16
+
+
+struct _snd_mixer_elem
+{
+    struct emu_elem_config config;
+    snd_mixer_elem_callback_t callback;
+    void* callback_private;
+    uint32_t changed;           // Mask of mixers with unhandled changes.
+};
+
+struct _snd_mixer
+{
+    int id;
+    int pipe_fds[2];            // Readable when there are changes to handle.
+};
+
+/* Opaque in alsa-lib, emulated card has no control interface */
+struct _snd_ctl_card_info
+{
+    char id[EMU_NAME_SIZE];
+};
+
+
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct _snd_mixer_elem emu_elems[EMU_MAX_ELEMS];
+static int emu_elems_size = 0;
+static struct _snd_mixer* emu_mixers[EMU_MAX_MIXERS];
+static long emu_latency_ns[trace_op_count];
+static long emu_writes = 0;
+
+
+/* Removes all elements and latencies. Mixers must be closed. */
+void emu_reset(void)
+{
+    pthread_mutex_lock(&emu_lock);
+    memset(emu_elems, 0, sizeof(emu_elems));
+    emu_elems_size = 0;
+    memset(emu_latency_ns, 0, sizeof(emu_latency_ns));
+    emu_writes = 0;
+    pthread_mutex_unlock(&emu_lock);
+}
+
+
+/* Adds element to the card. Returned config has stereo playback volume with
+ * range [0,100] and a playback switch, and can be changed until a mixer is
+ * opened. Returns NULL if the card is full. */
+struct emu_elem_config* emu_add_elem(char const* name)
+{
+    if (emu_elems_size == EMU_MAX_ELEMS) return NULL;
+
+    struct emu_elem_config* c = &emu_elems[emu_elems_size++].config;
+    memset(c, 0, sizeof(*c));
+    strncpy(c->name, name, EMU_NAME_SIZE - 1);
+    c->playback_channels = 1u << SND_MIXER_SCHN_FRONT_LEFT |
+        1u << SND_MIXER_SCHN_FRONT_RIGHT;
+    c->has_playback_volume = true;
+    c->has_playback_switch = true;
+    c->max = 100;
+    return c;
+}
+
+
+/* Sets latency of the mixer function with given trace op id. */
+void emu_set_latency(int op, long latency_ns)
+{
+    if (op >= 0 && op < trace_op_count)
+        emu_latency_ns[op] = latency_ns;
+}
+
+
+/* Gets number of writes done to the card since reset. */
+long emu_get_writes(void)
+{
+    return emu_writes;
+}
+
+
+/* Emulates latency of the operation */
+static void emu_delay(enum trace_op op)
+{
+    long const ns = emu_latency_ns[op];
+    if (ns <= 0) return;
+
+    /* Sleeping is too coarse for short latencies, spin instead */
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (ns > 200000) {
+        struct timespec t = { ns / 1000000000L, ns % 1000000000L };
+        nanosleep(&t, NULL);
+        return;
+    }
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000000L +
+            (now.tv_nsec - start.tv_nsec) < ns);
+}
+
+
+/* Counts a write to the element. If it changed a value the element is
+ * marked changed for all mixers and their pollers are woken up, like the
+ * driver sends an event only for a changed value. Expects emu_lock to be
+ * held. */
+static void emu_written(snd_mixer_elem_t* elem, bool changed)
+{
+    ++emu_writes;
+    if (!changed) return;
+    for (int i = 0; i < EMU_MAX_MIXERS; ++i) {
+        if (!emu_mixers[i]) continue;
+        if (!(elem->changed & (1u << i))) {
+            char const c = 0;
+            if (write(emu_mixers[i]->pipe_fds[1], &c, 1) != 1) continue;
+        }
+        elem->changed |= 1u << i;
+    }
+}
+
+
+static long clamp(snd_mixer_elem_t* elem, long value)
+{
+    return value < elem->config.min ? elem->config.min :
+        value > elem->config.max ? elem->config.max : value;
+}
+
+
+static long raw_to_dB(snd_mixer_elem_t* elem, long value)
+{
+    struct emu_elem_config const* c = &elem->config;
+    if (c->max == c->min) return c->dB_min;
+    return c->dB_min + (value - c->min) * (c->dB_max - c->dB_min) / (c->max - c->min);
+}
+
+
+static long dB_to_raw(snd_mixer_elem_t* elem, long dB, int dir)
+{
+    struct emu_elem_config const* c = &elem->config;
+    if (c->dB_max == c->dB_min) return c->min;
+    double const raw = c->min + (double)(dB - c->dB_min) * (c->max - c->min) /
+        (c->dB_max - c->dB_min);
+    return clamp(elem, lrint(dir > 0 ? ceil(raw) : dir < 0 ? floor(raw) : raw));
+}
+
+
+/*****************************************************************************
+ * Mixer functions
+ * */
+
+int snd_mixer_open(snd_mixer_t** mixer, int mode)
+{
+    emu_delay(trace_op_snd_mixer_open);
+    pthread_mutex_lock(&emu_lock);
+    int id = 0;
+    while (id < EMU_MAX_MIXERS && emu_mixers[id]) ++id;
+    struct _snd_mixer* m = id < EMU_MAX_MIXERS ? calloc(1, sizeof(*m)) : NULL;
+    if (m && pipe(m->pipe_fds) != 0) {
+        free(m);
+        m = NULL;
+    }
+    if (m) {
+        fcntl(m->pipe_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(m->pipe_fds[1], F_SETFL, O_NONBLOCK);
+        m->id = id;
+        emu_mixers[id] = m;
+    }
+    pthread_mutex_unlock(&emu_lock);
+    *mixer = m;
+    return m ? 0 : -ENOMEM;
+}
+
+int snd_mixer_close(snd_mixer_t* mixer)
+{
+    emu_delay(trace_op_snd_mixer_close);
+    pthread_mutex_lock(&emu_lock);
+    emu_mixers[mixer->id] = NULL;
+    for (int i = 0; i < emu_elems_size; ++i)
+        emu_elems[i].changed &= ~(1u << mixer->id);
+    pthread_mutex_unlock(&emu_lock);
+    close(mixer->pipe_fds[0]);
+    close(mixer->pipe_fds[1]);
+    free(mixer);
+    return 0;
+}
+
+int snd_mixer_attach(snd_mixer_t* mixer, const char* name)
+{
+    emu_delay(trace_op_snd_mixer_attach);
+    return 0;
+}
+
+int snd_mixer_selem_register(snd_mixer_t* mixer,
+        struct snd_mixer_selem_regopt* options, snd_mixer_class_t** classp)
+{
+    emu_delay(trace_op_snd_mixer_selem_register);
+    return 0;
+}
+
+int snd_mixer_load(snd_mixer_t* mixer)
+{
+    emu_delay(trace_op_snd_mixer_load);
+    return 0;
+}
+
+snd_mixer_elem_t* snd_mixer_first_elem(snd_mixer_t* mixer)
+{
+    emu_delay(trace_op_snd_mixer_first_elem);
+    return emu_elems_size > 0 ? &emu_elems[0] : NULL;
+}
+
+snd_mixer_elem_t* snd_mixer_elem_next(snd_mixer_elem_t* elem)
+{
+    emu_delay(trace_op_snd_mixer_elem_next);
+    return elem + 1 < emu_elems + emu_elems_size ? elem + 1 : NULL;
+}
+
+int snd_mixer_handle_events(snd_mixer_t* mixer)
+{
+    emu_delay(trace_op_snd_mixer_handle_events);
+    char buf[64];
+    while (read(mixer->pipe_fds[0], buf, sizeof(buf)) > 0)
+        ;
+
+    int count = 0;
+    uint32_t const bit = 1u << mixer->id;
+    for (int i = 0; i < emu_elems_size; ++i) {
+        pthread_mutex_lock(&emu_lock);
+        bool const changed = emu_elems[i].changed & bit;
+        emu_elems[i].changed &= ~bit;
+        pthread_mutex_unlock(&emu_lock);
+        if (!changed) continue;
+        ++count;
+        if (emu_elems[i].callback)
+            emu_elems[i].callback(&emu_elems[i], SND_CTL_EVENT_MASK_VALUE);
+    }
+    return count;
+}
+
+int snd_mixer_poll_descriptors_count(snd_mixer_t* mixer)
+{
+    emu_delay(trace_op_snd_mixer_poll_descriptors_count);
+    return 1;
+}
+
+int snd_mixer_poll_descriptors(snd_mixer_t* mixer, struct pollfd* pfds, unsigned int space)
+{
+    emu_delay(trace_op_snd_mixer_poll_descriptors);
+    if (space < 1) return 0;
+    pfds[0].fd = mixer->pipe_fds[0];
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    return 1;
+}
+
+int snd_mixer_poll_descriptors_revents(snd_mixer_t* mixer, struct pollfd* pfds,
+        unsigned int nfds, unsigned short* revents)
+{
+    emu_delay(trace_op_snd_mixer_poll_descriptors_revents);
+    *revents = nfds > 0 ? pfds[0].revents : 0;
+    return 0;
+}
+
+int snd_mixer_get_hctl(snd_mixer_t* mixer, const char* name, snd_hctl_t** hctl)
+{
+    return -ENOENT;
+}
+
+snd_ctl_t* snd_hctl_ctl(snd_hctl_t* hctl)
+{
+    return NULL;
+}
+
+int snd_ctl_card_info(snd_ctl_t* ctl, snd_ctl_card_info_t* info)
+{
+    return -ENODEV;
+}
+
+int snd_ctl_card_info_malloc(snd_ctl_card_info_t** ptr)
+{
+    *ptr = calloc(1, sizeof(**ptr));
+    return *ptr ? 0 : -ENOMEM;
+}
+
+void snd_ctl_card_info_free(snd_ctl_card_info_t* obj)
+{
+    free(obj);
+}
+
+const char* snd_ctl_card_info_get_id(const snd_ctl_card_info_t* obj)
+{
+    return obj->id;
+}
+
+const char* snd_strerror(int errnum)
+{
+    return strerror(errnum < 0 ? -errnum : errnum);
+}
+
+
+/*****************************************************************************
+ * Element functions
+ * */
+
+void snd_mixer_elem_set_callback(snd_mixer_elem_t* obj, snd_mixer_elem_callback_t val)
+{
+    obj->callback = val;
+}
+
+void snd_mixer_elem_set_callback_private(snd_mixer_elem_t* obj, void* val)
+{
+    obj->callback_private = val;
+}
+
+void* snd_mixer_elem_get_callback_private(const snd_mixer_elem_t* obj)
+{
+    return obj->callback_private;
+}
+
+const char* snd_mixer_selem_get_name(snd_mixer_elem_t* elem)
+{
+    return elem->config.name;
+}
+
+
+/* Generators for the functions which have playback and capture variants,
+ * vols and sws are the state fields of the direction */
+
+#define EMU_HAS_FN(dir, what, field) \
+int snd_mixer_selem_has_##dir##_##what(snd_mixer_elem_t* elem) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_has_##dir##_##what); \
+    return elem->config.field; \
+}
+
+#define EMU_HAS_CHANNEL_FN(dir) \
+int snd_mixer_selem_has_##dir##_channel(snd_mixer_elem_t* elem, \
+        snd_mixer_selem_channel_id_t channel) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_has_##dir##_channel); \
+    return channel >= 0 && channel <= SND_MIXER_SCHN_LAST && \
+        (elem->config.dir##_channels & (1u << channel)); \
+}
+
+#define EMU_VALID(elem, dir, channel, field) \
+    ((elem)->config.field && (channel) >= 0 && (channel) <= SND_MIXER_SCHN_LAST && \
+     ((elem)->config.dir##_channels & (1u << (channel))))
+
+#define EMU_VOLUME_FNS(dir, vols) \
+int snd_mixer_selem_get_##dir##_volume(snd_mixer_elem_t* elem, \
+        snd_mixer_selem_channel_id_t channel, long* value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_get_##dir##_volume); \
+    if (!EMU_VALID(elem, dir, channel, has_##dir##_volume)) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    *value = elem->config.vols[channel]; \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+} \
+int snd_mixer_selem_get_##dir##_dB(snd_mixer_elem_t* elem, \
+        snd_mixer_selem_channel_id_t channel, long* value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_get_##dir##_dB); \
+    if (!EMU_VALID(elem, dir, channel, has_##dir##_volume) || \
+            !elem->config.has_dB) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    *value = raw_to_dB(elem, elem->config.vols[channel]); \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+} \
+int snd_mixer_selem_set_##dir##_volume(snd_mixer_elem_t* elem, \
+        snd_mixer_selem_channel_id_t channel, long value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_set_##dir##_volume); \
+    if (!EMU_VALID(elem, dir, channel, has_##dir##_volume)) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    long const old = elem->config.vols[channel]; \
+    elem->config.vols[channel] = clamp(elem, value); \
+    emu_written(elem, elem->config.vols[channel] != old); \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+} \
+int snd_mixer_selem_set_##dir##_dB(snd_mixer_elem_t* elem, \
+        snd_mixer_selem_channel_id_t channel, long value, int dir_) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_set_##dir##_dB); \
+    if (!EMU_VALID(elem, dir, channel, has_##dir##_volume) || \
+            !elem->config.has_dB) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    long const old = elem->config.vols[channel]; \
+    elem->config.vols[channel] = dB_to_raw(elem, value, dir_); \
+    emu_written(elem, elem->config.vols[channel] != old); \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+} \
+int snd_mixer_selem_set_##dir##_volume_all(snd_mixer_elem_t* elem, long value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_set_##dir##_volume_all); \
+    if (!elem->config.has_##dir##_volume) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    bool changed = false; \
+    for (int c = 0; c <= SND_MIXER_SCHN_LAST; ++c) { \
+        long const old = elem->config.vols[c]; \
+        elem->config.vols[c] = clamp(elem, value); \
+        changed |= elem->config.vols[c] != old; \
+    } \
+    emu_written(elem, changed); \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+} \
+int snd_mixer_selem_get_##dir##_volume_range(snd_mixer_elem_t* elem, \
+        long* min, long* max) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_get_##dir##_volume_range); \
+    *min = elem->config.min; \
+    *max = elem->config.max; \
+    return 0; \
+} \
+int snd_mixer_selem_get_##dir##_dB_range(snd_mixer_elem_t* elem, \
+        long* min, long* max) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_get_##dir##_dB_range); \
+    if (!elem->config.has_dB) return -EINVAL; \
+    *min = elem->config.dB_min; \
+    *max = elem->config.dB_max; \
+    return 0; \
+} \
+int snd_mixer_selem_ask_##dir##_dB_vol(snd_mixer_elem_t* elem, \
+        long dBvalue, int dir_, long* value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_ask_##dir##_dB_vol); \
+    if (!elem->config.has_dB) return -EINVAL; \
+    *value = dB_to_raw(elem, dBvalue, dir_); \
+    return 0; \
+} \
+int snd_mixer_selem_ask_##dir##_vol_dB(snd_mixer_elem_t* elem, \
+        long value, long* dBvalue) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_ask_##dir##_vol_dB); \
+    if (!elem->config.has_dB) return -EINVAL; \
+    *dBvalue = raw_to_dB(elem, clamp(elem, value)); \
+    return 0; \
+}
+
+#define EMU_SWITCH_FNS(dir, sws) \
+int snd_mixer_selem_get_##dir##_switch(snd_mixer_elem_t* elem, \
+        snd_mixer_selem_channel_id_t channel, int* value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_get_##dir##_switch); \
+    if (!EMU_VALID(elem, dir, channel, has_##dir##_switch)) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    *value = (elem->config.sws >> channel) & 1; \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+} \
+int snd_mixer_selem_set_##dir##_switch(snd_mixer_elem_t* elem, \
+        snd_mixer_selem_channel_id_t channel, int value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_set_##dir##_switch); \
+    if (!EMU_VALID(elem, dir, channel, has_##dir##_switch)) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    uint32_t const old = elem->config.sws; \
+    if (value) elem->config.sws |= 1u << channel; \
+    else elem->config.sws &= ~(1u << channel); \
+    emu_written(elem, elem->config.sws != old); \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+} \
+int snd_mixer_selem_set_##dir##_switch_all(snd_mixer_elem_t* elem, int value) \
+{ \
+    emu_delay(trace_op_snd_mixer_selem_set_##dir##_switch_all); \
+    if (!elem->config.has_##dir##_switch) return -EINVAL; \
+    pthread_mutex_lock(&emu_lock); \
+    uint32_t const old = elem->config.sws; \
+    elem->config.sws = value ? elem->config.dir##_channels : 0; \
+    emu_written(elem, elem->config.sws != old); \
+    pthread_mutex_unlock(&emu_lock); \
+    return 0; \
+}
+
+EMU_HAS_FN(playback, switch, has_playback_switch)
+EMU_HAS_FN(playback, volume, has_playback_volume)
+EMU_HAS_CHANNEL_FN(playback)
+EMU_VOLUME_FNS(playback, volumes)
+EMU_SWITCH_FNS(playback, switches)
+
+EMU_HAS_FN(capture, switch, has_capture_switch)
+EMU_HAS_FN(capture, volume, has_capture_volume)
+EMU_HAS_CHANNEL_FN(capture)
+EMU_VOLUME_FNS(capture, capture_volumes)
+EMU_SWITCH_FNS(capture, capture_switches)
+
+int snd_mixer_selem_set_playback_dB_all(snd_mixer_elem_t* elem, long value, int dir)
+{
+    emu_delay(trace_op_snd_mixer_selem_set_playback_dB_all);
+    if (!elem->config.has_playback_volume || !elem->config.has_dB) return -EINVAL;
+    pthread_mutex_lock(&emu_lock);
+    bool changed = false;
+    for (int c = 0; c <= SND_MIXER_SCHN_LAST; ++c) {
+        long const old = elem->config.volumes[c];
+        elem->config.volumes[c] = dB_to_raw(elem, value, dir);
+        changed |= elem->config.volumes[c] != old;
+    }
+    emu_written(elem, changed);
+    pthread_mutex_unlock(&emu_lock);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef EMU_MIXER_H_INCLUDED
+#define EMU_MIXER_H_INCLUDED
+/* Emulated sound card implementing the part of the alsa-lib mixer interface
+ * avolt uses. Tools link against this in place of alsa-lib to run avolt
+ * code without sound hardware.
+ *
+ * There is one emulated card, shared by all opened mixers. Elements are
+ * added with emu_add_elem before opening mixers. Writes which change a value
+ * make the mixer poll descriptors readable and snd_mixer_handle_events calls
+ * the element callbacks of changed elements. Playback and capture have their own
+ * volumes and switches but share the range. dB values are mapped linearly
+ * over the hardware range, like with a TLV_DB_SCALE control.
+ */
+
+#include <alsa/asoundlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define EMU_NAME_SIZE 32
+#define EMU_MAX_ELEMS 256
+
+
+struct emu_elem_config
+{
+    char name[EMU_NAME_SIZE];
+
+    uint32_t playback_channels;     // Channel masks.
+    uint32_t capture_channels;
+    bool has_playback_volume;
+    bool has_playback_switch;
+    bool has_capture_volume;
+    bool has_capture_switch;
+
+    long min, max;                  // Hardware volume range.
+    bool has_dB;
+    long dB_min, dB_max;            // In 0.01 dB.
+
+    long volumes[SND_MIXER_SCHN_LAST + 1];          // Playback.
+    uint32_t switches;              // Playback switch state mask.
+    long capture_volumes[SND_MIXER_SCHN_LAST + 1];
+    uint32_t capture_switches;
+};
+
+
+void emu_reset(void);
+
+struct emu_elem_config* emu_add_elem(char const* name);
+
+void emu_set_latency(int op, long latency_ns);
+
+long emu_get_writes(void);
+
+#endif
@@ -0,0 +1,25 @@
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "tool_util.h"
+
+
+void remove_tree(char const* path)
+{
+    DIR* dir = opendir(path);
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir))) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+            char sub_path[PATH_MAX];
+            snprintf(sub_path, sizeof(sub_path), "%s/%s", path, entry->d_name);
+            if (unlink(sub_path) != 0) remove_tree(sub_path);
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
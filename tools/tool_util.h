@@ -0,0 +1,9 @@
+#ifndef TOOL_UTIL_H_INCLUDED
+#define TOOL_UTIL_H_INCLUDED
+/* Helpers shared by the development tools */
+
+
+/* Removes a temporary directory and the files runs left in it */
+void remove_tree(char const* path);
+
+#endif